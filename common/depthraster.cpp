@@ -0,0 +1,197 @@
+#include <vector>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DEPTHRASTER_SSE
+#endif
+
+#include "depthraster.hpp"
+
+void resizeDepthBuffer(DepthBuffer & buffer, int width, int height){
+	buffer.width = (width + 3) & ~3;
+	buffer.height = height;
+	buffer.levels.clear();
+	buffer.levelWidths.clear();
+	buffer.levelHeights.clear();
+	int w = buffer.width, h = buffer.height;
+	for (;;){
+		buffer.levels.push_back(std::vector<float>(w * h, 0.0f));
+		buffer.levelWidths.push_back(w);
+		buffer.levelHeights.push_back(h);
+		if ( w == 1 && h == 1 )
+			break;
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+	}
+}
+
+void clearDepthBuffer(DepthBuffer & buffer){
+	for ( size_t l=0; l<buffer.levels.size(); l++ )
+		buffer.levels[l].assign(buffer.levels[l].size(), 0.0f);
+}
+
+// Edge functions and depth plane of a triangle, and the pixels to visit.
+// e[i](x, y) = a[i] * x + b[i] * y + c[i] is the weight of vertex i, scaled
+// so that the three sum to 1 : a pixel center is inside when all three
+// are >= 0.
+struct TriangleSetup {
+	float a[3], b[3], c[3];
+	float za, zb, zc;
+	int minX, maxX, minY, maxY;
+};
+
+static bool setupTriangle(const ScreenTriangle & t, int width, int rowBegin, int rowEnd, TriangleSetup & s){
+	for ( int i=0; i<3; i++ ){
+		int j = (i + 1) % 3, k = (i + 2) % 3;
+		s.a[i] = t.y[j] - t.y[k];
+		s.b[i] = t.x[k] - t.x[j];
+		s.c[i] = t.x[j] * t.y[k] - t.x[k] * t.y[j];
+	}
+	// Twice the signed area. Flipping the sign handles both windings.
+	float area = s.c[0] + s.c[1] + s.c[2];
+	if ( fabsf(area) < 1e-8f )
+		return false;
+	float invArea = 1.0f / area;
+	s.za = s.zb = s.zc = 0.0f;
+	for ( int i=0; i<3; i++ ){
+		s.a[i] *= invArea;
+		s.b[i] *= invArea;
+		s.c[i] *= invArea;
+		s.za += s.a[i] * t.invW[i];
+		s.zb += s.b[i] * t.invW[i];
+		s.zc += s.c[i] * t.invW[i];
+	}
+
+	// Pixels whose center is in the bounding box
+	float minX = fminf(t.x[0], fminf(t.x[1], t.x[2]));
+	float maxX = fmaxf(t.x[0], fmaxf(t.x[1], t.x[2]));
+	float minY = fminf(t.y[0], fminf(t.y[1], t.y[2]));
+	float maxY = fmaxf(t.y[0], fmaxf(t.y[1], t.y[2]));
+	s.minX = minX - 0.5f > 0.0f ? (int)ceilf(minX - 0.5f) : 0;
+	s.minY = minY - 0.5f > (float)rowBegin ? (int)ceilf(minY - 0.5f) : rowBegin;
+	s.maxX = maxX - 0.5f < (float)(width - 1) ? (int)floorf(maxX - 0.5f) : width - 1;
+	s.maxY = maxY - 0.5f < (float)(rowEnd - 1) ? (int)floorf(maxY - 0.5f) : rowEnd - 1;
+	return s.minX <= s.maxX && s.minY <= s.maxY;
+}
+
+void rasterizeTriangles_scalar(DepthBuffer & buffer, const std::vector<ScreenTriangle> & triangles, int rowBegin, int rowEnd){
+	std::vector<float> & depth = buffer.levels[0];
+	for ( size_t t=0; t<triangles.size(); t++ ){
+		TriangleSetup s;
+		if ( !setupTriangle(triangles[t], buffer.width, rowBegin, rowEnd, s) )
+			continue;
+		for ( int y=s.minY; y<=s.maxY; y++ ){
+			float yc = y + 0.5f;
+			float * row = &depth[y * buffer.width];
+			for ( int x=s.minX; x<=s.maxX; x++ ){
+				float xc = x + 0.5f;
+				float e0 = s.a[0] * xc + (s.b[0] * yc + s.c[0]);
+				float e1 = s.a[1] * xc + (s.b[1] * yc + s.c[1]);
+				float e2 = s.a[2] * xc + (s.b[2] * yc + s.c[2]);
+				if ( e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f ){
+					float z = s.za * xc + (s.zb * yc + s.zc);
+					if ( z > row[x] )
+						row[x] = z;
+				}
+			}
+		}
+	}
+}
+
+#ifdef DEPTHRASTER_SSE
+
+void rasterizeTriangles(DepthBuffer & buffer, const std::vector<ScreenTriangle> & triangles, int rowBegin, int rowEnd){
+	std::vector<float> & depth = buffer.levels[0];
+	const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+	for ( size_t t=0; t<triangles.size(); t++ ){
+		TriangleSetup s;
+		if ( !setupTriangle(triangles[t], buffer.width, rowBegin, rowEnd, s) )
+			continue;
+		const __m128 a0 = _mm_set1_ps(s.a[0]), a1 = _mm_set1_ps(s.a[1]), a2 = _mm_set1_ps(s.a[2]);
+		const __m128 za = _mm_set1_ps(s.za);
+		// The width is a multiple of 4 : aligned groups of 4 stay in the row
+		int firstX = s.minX & ~3;
+		for ( int y=s.minY; y<=s.maxY; y++ ){
+			float yc = y + 0.5f;
+			const __m128 r0 = _mm_set1_ps(s.b[0] * yc + s.c[0]);
+			const __m128 r1 = _mm_set1_ps(s.b[1] * yc + s.c[1]);
+			const __m128 r2 = _mm_set1_ps(s.b[2] * yc + s.c[2]);
+			const __m128 rz = _mm_set1_ps(s.zb * yc + s.zc);
+			float * row = &depth[y * buffer.width];
+			for ( int x=firstX; x<=s.maxX; x+=4 ){
+				__m128 xc = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+				__m128 inside = _mm_and_ps(
+					_mm_and_ps(
+						_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, xc), r0), zero),
+						_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, xc), r1), zero)),
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, xc), r2), zero));
+				if ( _mm_movemask_ps(inside) == 0 )
+					continue;
+				__m128 z = _mm_add_ps(_mm_mul_ps(za, xc), rz);
+				__m128 old = _mm_loadu_ps(row + x);
+				__m128 nearest = _mm_max_ps(old, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+			}
+		}
+	}
+}
+
+#else
+
+void rasterizeTriangles(DepthBuffer & buffer, const std::vector<ScreenTriangle> & triangles, int rowBegin, int rowEnd){
+	rasterizeTriangles_scalar(buffer, triangles, rowBegin, rowEnd);
+}
+
+#endif
+
+void buildDepthPyramid(DepthBuffer & buffer){
+	for ( size_t l=1; l<buffer.levels.size(); l++ ){
+		const std::vector<float> & below = buffer.levels[l - 1];
+		std::vector<float> & level = buffer.levels[l];
+		int belowWidth = buffer.levelWidths[l - 1], belowHeight = buffer.levelHeights[l - 1];
+		int width = buffer.levelWidths[l], height = buffer.levelHeights[l];
+		for ( int y=0; y<height; y++ ){
+			int y0 = 2 * y, y1 = 2 * y + 1 < belowHeight ? 2 * y + 1 : 2 * y;
+			for ( int x=0; x<width; x++ ){
+				int x0 = 2 * x, x1 = 2 * x + 1 < belowWidth ? 2 * x + 1 : 2 * x;
+				float farthest = fminf(fminf(below[y0 * belowWidth + x0], below[y0 * belowWidth + x1]),
+				                       fminf(below[y1 * belowWidth + x0], below[y1 * belowWidth + x1]));
+				level[y * width + x] = farthest;
+			}
+		}
+	}
+}
+
+bool isRectVisible(const DepthBuffer & buffer, float minX, float minY, float maxX, float maxY, float nearestInvW){
+	// Off screen : not for this test to say
+	if ( maxX < 0.0f || maxY < 0.0f || minX >= (float)buffer.width || minY >= (float)buffer.height )
+		return true;
+	// Occluders are sampled at pixel centers : a pixel they only partly
+	// cover reads as covered. One more texel on each side reaches a pixel
+	// the occluder's edge leaves uncovered.
+	minX -= 1.0f;
+	minY -= 1.0f;
+	maxX += 1.0f;
+	maxY += 1.0f;
+	int x0 = minX > 0.0f ? (int)minX : 0;
+	int y0 = minY > 0.0f ? (int)minY : 0;
+	int x1 = maxX < (float)(buffer.width - 1) ? (int)maxX : buffer.width - 1;
+	int y1 = maxY < (float)(buffer.height - 1) ? (int)maxY : buffer.height - 1;
+
+	// The finest level where the rectangle spans at most 3x3 texels
+	size_t level = 0;
+	while ( level + 1 < buffer.levels.size() && ((x1 >> level) - (x0 >> level) > 2 || (y1 >> level) - (y0 >> level) > 2) )
+		level++;
+
+	const std::vector<float> & depth = buffer.levels[level];
+	int width = buffer.levelWidths[level];
+	for ( int y=(y0 >> level); y<=(y1 >> level); y++ ){
+		for ( int x=(x0 >> level); x<=(x1 >> level); x++ ){
+			if ( nearestInvW >= depth[y * width + x] )
+				return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,52 @@
+#ifndef DEPTHRASTER_HPP
+#define DEPTHRASTER_HPP
+
+#include <vector>
+
+// Software depth buffer for occlusion culling : a few occluders are
+// rasterized at low resolution, then the screen rectangles of objects are
+// tested against a hierarchical Z pyramid built from it.
+// Depths are 1/w, so that they interpolate linearly on screen : 0 is
+// infinitely far, larger is nearer.
+
+// Pixel (x, y) covers [x, x+1) x [y, y+1). Triangles are sampled at pixel
+// centers, in either winding.
+struct ScreenTriangle {
+	float x[3];
+	float y[3];
+	float invW[3];
+};
+
+struct DepthBuffer {
+	int width;  // multiple of 4
+	int height;
+	// levels[0] is the buffer itself, row by row. Each next level holds
+	// the farthest depth of 2x2 texels of the previous one.
+	std::vector< std::vector<float> > levels;
+	std::vector<int> levelWidths;
+	std::vector<int> levelHeights;
+};
+
+void resizeDepthBuffer(DepthBuffer & buffer, int width, int height);
+
+// Everything infinitely far
+void clearDepthBuffer(DepthBuffer & buffer);
+
+// Keeps the nearest depth of the triangles in rows [rowBegin, rowEnd) of
+// level 0, 4 pixels at a time with SSE when the compiler targets it.
+// Disjoint row ranges can be rasterized on different threads.
+void rasterizeTriangles(DepthBuffer & buffer, const std::vector<ScreenTriangle> & triangles, int rowBegin, int rowEnd);
+
+// Same result, one pixel at a time
+void rasterizeTriangles_scalar(DepthBuffer & buffer, const std::vector<ScreenTriangle> & triangles, int rowBegin, int rowEnd);
+
+// Rebuilds the levels above 0
+void buildDepthPyramid(DepthBuffer & buffer);
+
+// False when everything in the rectangle of pixels [minX, maxX] x [minY, maxY],
+// widened by one pixel on each side, is nearer than nearestInvW : an object
+// there, no nearer than that, is hidden. Reads at most 3x3 texels of the
+// pyramid.
+bool isRectVisible(const DepthBuffer & buffer, float minX, float minY, float maxX, float maxY, float nearestInvW);
+
+#endif
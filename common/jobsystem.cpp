@@ -0,0 +1,119 @@
+#include <algorithm>
+
+#include "jobsystem.hpp"
+
+JobSystem::JobSystem(unsigned int threadCount) : queued(0), unfinished(0) {
+	if( threadCount == 0 )
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	for( unsigned int k=0; k<threadCount; k++ )
+		queues.emplace_back(new TaskQueue());
+	// Queue 0 belongs to the caller of parallelFor
+	for( unsigned int k=1; k<threadCount; k++ )
+		workers.emplace_back(&JobSystem::workerLoop, this, k);
+}
+
+JobSystem::~JobSystem(){
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for( size_t k=0; k<workers.size(); k++ )
+		workers[k].join();
+}
+
+unsigned int JobSystem::getThreadCount() const {
+	return (unsigned int)queues.size();
+}
+
+bool JobSystem::runOne(unsigned int self){
+	Task task;
+	bool found = false;
+
+	// Own queue first, newest task : its data is the most likely in cache
+	{
+		TaskQueue & own = *queues[self];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if( !own.tasks.empty() ){
+			task = own.tasks.back();
+			own.tasks.pop_back();
+			found = true;
+		}
+	}
+	// Then steal the oldest task of the next busy queue
+	for( unsigned int k=1; !found && k<queues.size(); k++ ){
+		TaskQueue & victim = *queues[(self + k) % queues.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if( !victim.tasks.empty() ){
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+			found = true;
+		}
+	}
+	if( !found )
+		return false;
+
+	queued--;
+	(*task.job)(task.begin, task.end);
+	unfinished--;
+	return true;
+}
+
+void JobSystem::workerLoop(unsigned int self){
+	for(;;){
+		if( runOne(self) )
+			continue;
+		std::unique_lock<std::mutex> lock(wakeMutex);
+		wake.wait(lock, [this]{ return stopping || queued.load() != 0; });
+		if( stopping )
+			return;
+	}
+}
+
+void JobSystem::parallelFor(size_t first, size_t last, size_t grainSize, const RangeJob & job){
+	if( first >= last )
+		return;
+	grainSize = std::max<size_t>(1, grainSize);
+	size_t taskCount = (last - first + grainSize - 1) / grainSize;
+	if( queues.size() == 1 ){ // Nobody to share with : the same chunks, in order
+		for( size_t begin=first; begin<last; ){
+			size_t end = begin + std::min(grainSize, last - begin);
+			job(begin, end);
+			begin = end;
+		}
+		return;
+	}
+	if( taskCount == 1 ){
+		job(first, last);
+		return;
+	}
+
+	// Count the tasks before anyone can run them. Under the lock, so that a
+	// worker can't miss the wake-up between its check and its wait.
+	unfinished += taskCount;
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		queued += taskCount;
+	}
+
+	// Deal the tasks out in contiguous blocks, one per thread : each thread
+	// starts on its own part of the arrays, and only steals at the end.
+	for( size_t k=0; k<queues.size(); k++ ){
+		size_t begin = taskCount * k / queues.size();
+		size_t end = taskCount * (k + 1) / queues.size();
+		if( begin == end )
+			continue;
+		TaskQueue & queue = *queues[k];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		// Backwards, so that popping from the back goes through the block in order
+		for( size_t t=end; t-- > begin; )
+			queue.tasks.push_back({&job, first + t * grainSize, std::min(last, first + (t + 1) * grainSize)});
+	}
+	wake.notify_all();
+
+	// Help until everything is done, including the tasks other threads took
+	while( unfinished.load() != 0 ){
+		if( !runOne(0) )
+			std::this_thread::yield();
+	}
+}
@@ -0,0 +1,65 @@
+#ifndef JOBSYSTEM_HPP
+#define JOBSYSTEM_HPP
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Range of items handed to a parallelFor job
+typedef std::function<void(size_t begin, size_t end)> RangeJob;
+
+// Work-stealing thread pool. Each thread (the caller of parallelFor
+// included) owns a deque of tasks : it takes its own from the back, and
+// when it runs out, steals from the front of the others'.
+class JobSystem {
+public:
+	// threadCount counts the calling thread; 0 = one per core
+	explicit JobSystem(unsigned int threadCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem &) = delete;
+	JobSystem & operator=(const JobSystem &) = delete;
+
+	unsigned int getThreadCount() const;
+
+	// Calls job on consecutive sub-ranges of [first, last) of at most
+	// grainSize items, on every thread, and returns once all are done.
+	// Only one thread may call it at a time, and jobs must not call it.
+	void parallelFor(size_t first, size_t last, size_t grainSize, const RangeJob & job);
+
+private:
+	struct Task {
+		const RangeJob * job;
+		size_t begin;
+		size_t end;
+	};
+
+	struct TaskQueue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void workerLoop(unsigned int self);
+
+	// Runs one task from queue self, or stolen from another one
+	bool runOne(unsigned int self);
+
+	std::vector<std::unique_ptr<TaskQueue>> queues;
+	std::vector<std::thread> workers;
+
+	// Tasks pushed and not run yet, and not finished yet
+	std::atomic<size_t> queued;
+	std::atomic<size_t> unfinished;
+
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+	bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mappedfile.hpp"
+
+#ifdef _WIN32
+
+bool mapFile(const char * path, MappedFile & out){
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if( file == INVALID_HANDLE_VALUE )
+		return false;
+
+	LARGE_INTEGER size;
+	if( !GetFileSizeEx(file, &size) ){
+		CloseHandle(file);
+		return false;
+	}
+
+	MappedFile result;
+	result.size = (size_t)size.QuadPart;
+	if( result.size > 0 ){
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if( mapping == NULL ){
+			CloseHandle(file);
+			return false;
+		}
+		result.mapping = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping); // The view keeps the mapping alive
+		result.data = (const char *)result.mapping;
+		if( result.data == NULL ){
+			CloseHandle(file);
+			return false;
+		}
+	}
+	CloseHandle(file); // Same for the file
+	out = result;
+	return true;
+}
+
+void unmapFile(MappedFile & file){
+	if( file.mapping != nullptr )
+		UnmapViewOfFile(file.mapping);
+	file = MappedFile();
+}
+
+#else
+
+bool mapFile(const char * path, MappedFile & out){
+	int fd = open(path, O_RDONLY);
+	if( fd < 0 )
+		return false;
+
+	struct stat st;
+	if( fstat(fd, &st) != 0 ){
+		close(fd);
+		return false;
+	}
+
+	MappedFile result;
+	result.size = (size_t)st.st_size;
+	if( result.size > 0 ){
+		void * mapping = mmap(nullptr, result.size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if( mapping == MAP_FAILED ){
+			close(fd);
+			return false;
+		}
+		// We read front to back, let the kernel read ahead aggressively
+		madvise(mapping, result.size, MADV_SEQUENTIAL);
+		result.mapping = mapping;
+		result.data = (const char *)mapping;
+	}
+	close(fd); // The mapping keeps its own reference to the file
+	out = result;
+	return true;
+}
+
+void unmapFile(MappedFile & file){
+	if( file.mapping != nullptr )
+		munmap(file.mapping, file.size);
+	file = MappedFile();
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <stddef.h>
+
+// Read-only view of a whole file, mapped into the address space.
+// The pages are only faulted in when they are touched, so mapping a
+// large file is almost free and parsing it needs no intermediate copy.
+struct MappedFile {
+	const char * data = nullptr;
+	size_t size = 0;
+
+	// Start of the mapping as returned by the OS, only meaningful between
+	// mapFile and unmapFile
+	void * mapping = nullptr;
+};
+
+// Maps the file at path. Returns false (and leaves out untouched) if the
+// file can't be opened. An empty file maps successfully with data == nullptr.
+bool mapFile(const char * path, MappedFile & out);
+
+void unmapFile(MappedFile & file);
+
+#endif
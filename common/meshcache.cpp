@@ -0,0 +1,322 @@
+#include <vector>
+#include <string>
+#include <utility>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include <glm/glm.hpp>
+
+#include "meshcache.hpp"
+#include "objloader.hpp"
+#include "vbooptimizer.hpp"
+#include "vbosimplifier.hpp"
+
+struct MeshSourceKey {
+	uint64_t size;
+	int64_t mtime;
+};
+
+static bool statMeshSource(const char * path, MeshSourceKey & key){
+	struct stat st;
+	if( stat(path, &st) != 0 )
+		return false;
+	key.size = (uint64_t)st.st_size;
+	key.mtime = (int64_t)st.st_mtime;
+	return true;
+}
+
+// 64-bit FNV-1a. Only used to tell a touched file from a modified one.
+static uint64_t hashBytes(const char * data, size_t size){
+	uint64_t hash = 14695981039346656037ull;
+	for( size_t i=0; i<size; i++ ){
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static bool hashFile(const char * path, uint64_t & hash){
+	MappedFile file;
+	if( !mapFile(path, file) )
+		return false;
+	hash = hashBytes(file.data, file.size);
+	unmapFile(file);
+	return true;
+}
+
+static uint64_t alignBlob(uint64_t offset){
+	return (offset + kMeshBinAlignment - 1) / kMeshBinAlignment * kMeshBinAlignment;
+}
+
+static bool blobInFile(const MeshBinBlob & blob, size_t fileSize){
+	return blob.offset % kMeshBinAlignment == 0 && blob.offset <= fileSize && blob.size <= fileSize - blob.offset;
+}
+
+static const MeshBinAttribute * findAttribute(const MeshBinHeader & header, MeshBinSemantic semantic){
+	for( uint32_t i=0; i<header.attributeCount; i++ )
+		if( header.attributes[i].semantic == (uint32_t)semantic )
+			return &header.attributes[i];
+	return nullptr;
+}
+
+// Checks that the attribute is there with the layout we expect
+static const void * attributeData(const MeshBin & mesh, const char * base, MeshBinSemantic semantic, uint32_t componentCount){
+	const MeshBinAttribute * attribute = findAttribute(*mesh.header, semantic);
+	if( attribute == nullptr ||
+		attribute->componentType != MESHBIN_FLOAT ||
+		attribute->componentCount != componentCount ||
+		attribute->stride != componentCount * sizeof(float) ||
+		attribute->data.size != (uint64_t)mesh.header->vertexCount * attribute->stride )
+		return nullptr;
+	return base + attribute->data.offset;
+}
+
+// Validates the header found at base and points the mesh into it
+static bool bindMeshBin(MeshBin & mesh, const char * base, size_t size){
+	if( size < sizeof(MeshBinHeader) )
+		return false;
+	const MeshBinHeader * header = (const MeshBinHeader *)base;
+	if( memcmp(header->magic, kMeshBinMagic, sizeof(kMeshBinMagic)) != 0 ||
+		header->version != kMeshBinVersion ||
+		header->headerSize != sizeof(MeshBinHeader) ||
+		header->attributeCount > kMeshBinMaxAttributes )
+		return false;
+	for( uint32_t i=0; i<header->attributeCount; i++ )
+		if( !blobInFile(header->attributes[i].data, size) )
+			return false;
+	if( !blobInFile(header->indices, size) )
+		return false;
+
+	mesh.header = header;
+	mesh.vertexCount = header->vertexCount;
+	mesh.positions = (const glm::vec3 *)attributeData(mesh, base, MESHBIN_POSITION, 3);
+	mesh.uvs       = (const glm::vec2 *)attributeData(mesh, base, MESHBIN_UV, 2);
+	mesh.normals   = (const glm::vec3 *)attributeData(mesh, base, MESHBIN_NORMAL, 3);
+	if( mesh.positions == nullptr || mesh.uvs == nullptr || mesh.normals == nullptr )
+		return false;
+
+	mesh.indexCount = header->indexCount;
+	mesh.indices = nullptr;
+	if( header->indexCount > 0 ){
+		if( header->indexType != MESHBIN_UNSIGNED_INT || header->indices.size != (uint64_t)header->indexCount * sizeof(unsigned int) )
+			return false;
+		mesh.indices = (const unsigned int *)(base + header->indices.offset);
+		// A stale or damaged file must not send the GPU, or whoever reads
+		// the indices on the CPU, past the vertices
+		for( uint32_t i=0; i<header->indexCount; i++ )
+			if( mesh.indices[i] >= header->vertexCount )
+				return false;
+	}
+
+	if( header->lodCount == 0 || header->lodCount > kMeshBinMaxLods )
+		return false;
+	for( uint32_t i=0; i<header->lodCount; i++ ){
+		const MeshBinLod & lod = header->lods[i];
+		if( lod.indexOffset > header->indexCount || lod.indexCount > header->indexCount - lod.indexOffset )
+			return false;
+	}
+	mesh.lodCount = header->lodCount;
+	mesh.lods = header->lods;
+
+	if( !blobInFile(header->meshlets, size) || header->meshlets.size != (uint64_t)header->meshletCount * sizeof(Meshlet) )
+		return false;
+	const Meshlet * meshlets = (const Meshlet *)(base + header->meshlets.offset);
+	for( uint32_t i=0; i<header->meshletCount; i++ )
+		if( meshlets[i].indexOffset > mesh.lods[0].indexCount ||
+			meshlets[i].triangleCount * 3 > mesh.lods[0].indexCount - meshlets[i].indexOffset )
+			return false;
+	mesh.meshletCount = header->meshletCount;
+	mesh.meshlets = meshlets;
+	return true;
+}
+
+// Lays out the whole file in memory
+static void buildMeshBinImage(
+	const MeshSourceKey & key,
+	uint64_t hash,
+	const std::vector<unsigned int> & indices,
+	const std::vector<MeshBinLod> & lods,
+	const std::vector<Meshlet> & meshlets,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	std::vector<char> & image
+){
+	MeshBinHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kMeshBinMagic, sizeof(kMeshBinMagic));
+	header.version = kMeshBinVersion;
+	header.headerSize = sizeof(MeshBinHeader);
+	header.sourceSize = key.size;
+	header.sourceMtime = key.mtime;
+	header.sourceHash = hash;
+	header.vertexCount = (uint32_t)vertices.size();
+	header.indexCount = (uint32_t)indices.size();
+	header.indexType = MESHBIN_UNSIGNED_INT;
+	header.lodCount = (uint32_t)lods.size();
+	for( size_t i=0; i<lods.size(); i++ )
+		header.lods[i] = lods[i];
+
+	const void * blobs[kMeshBinMaxAttributes];
+	uint64_t offset = alignBlob(sizeof(MeshBinHeader));
+	struct { MeshBinSemantic semantic; uint32_t componentCount; const void * data; } streams[] = {
+		{ MESHBIN_POSITION, 3, vertices.data() },
+		{ MESHBIN_UV,       2, uvs.data() },
+		{ MESHBIN_NORMAL,   3, normals.data() },
+	};
+	for( const auto & stream : streams ){
+		MeshBinAttribute & attribute = header.attributes[header.attributeCount];
+		attribute.semantic = stream.semantic;
+		attribute.componentType = MESHBIN_FLOAT;
+		attribute.componentCount = stream.componentCount;
+		attribute.stride = stream.componentCount * sizeof(float);
+		attribute.data.offset = offset;
+		attribute.data.size = (uint64_t)header.vertexCount * attribute.stride;
+		blobs[header.attributeCount++] = stream.data;
+		offset = alignBlob(offset + attribute.data.size);
+	}
+	header.indices.offset = offset;
+	header.indices.size = (uint64_t)header.indexCount * sizeof(unsigned int);
+	header.meshletCount = (uint32_t)meshlets.size();
+	header.meshlets.offset = alignBlob(header.indices.offset + header.indices.size);
+	header.meshlets.size = (uint64_t)header.meshletCount * sizeof(Meshlet);
+
+	image.assign(header.meshlets.offset + header.meshlets.size, 0);
+	memcpy(image.data(), &header, sizeof(header));
+	for( uint32_t i=0; i<header.attributeCount; i++ )
+		if( header.attributes[i].data.size > 0 )
+			memcpy(image.data() + header.attributes[i].data.offset, blobs[i], header.attributes[i].data.size);
+	if( header.indices.size > 0 )
+		memcpy(image.data() + header.indices.offset, indices.data(), header.indices.size);
+	if( header.meshlets.size > 0 )
+		memcpy(image.data() + header.meshlets.offset, meshlets.data(), header.meshlets.size);
+}
+
+// Simplifies the mesh to 1/2, 1/4... of its triangles, until the simplifier
+// can't make progress anymore. Every LOD gets its own vertex cache pass, and
+// they are all appended to indices.
+static void buildMeshLods(
+	std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	std::vector<MeshBinLod> & lods
+){
+	MeshBinLod full = { 0, (uint32_t)indices.size(), 0.0f, 0 };
+	lods.assign(1, full);
+
+	std::vector<unsigned int> fullIndices(indices);
+	std::vector<unsigned int> simplified;
+	while( lods.size() < kMeshBinMaxLods ){
+		const MeshBinLod & previous = lods.back();
+		size_t target = fullIndices.size() / 3 >> lods.size();
+		float error = simplifyMesh(fullIndices, vertices, uvs, target * 3, simplified);
+		// Not worth a LOD if it barely saves anything
+		if( simplified.empty() || simplified.size() > previous.indexCount * 3 / 4 )
+			break;
+		optimizeVertexCache(simplified, vertices.size());
+
+		MeshBinLod lod = { (uint32_t)indices.size(), (uint32_t)simplified.size(), error, 0 };
+		indices.insert(indices.end(), simplified.begin(), simplified.end());
+		lods.push_back(lod);
+		printf("LOD %u : %u triangles, error %g\n", (unsigned int)lods.size() - 1, lod.indexCount / 3, error);
+	}
+}
+
+// Writes to a temporary file first, so a crash never leaves a truncated cache behind
+static bool writeMeshBinImage(const std::string & path, const std::vector<char> & image){
+	std::string temporary = path + ".tmp";
+	FILE * file = fopen(temporary.c_str(), "wb");
+	if( file == NULL )
+		return false;
+	bool written = fwrite(image.data(), 1, image.size(), file) == image.size();
+	written = fclose(file) == 0 && written;
+	remove(path.c_str()); // rename() doesn't replace an existing file on Windows
+	if( !written || rename(temporary.c_str(), path.c_str()) != 0 ){
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Records the new mtime of a source whose content didn't change, so the
+// next run can skip hashing it again
+static void refreshMeshBinMtime(const std::string & path, int64_t mtime){
+	FILE * file = fopen(path.c_str(), "r+b");
+	if( file == NULL )
+		return;
+	if( fseek(file, offsetof(MeshBinHeader, sourceMtime), SEEK_SET) == 0 )
+		fwrite(&mtime, sizeof(mtime), 1, file);
+	fclose(file);
+}
+
+bool loadMeshBin(const char * objPath, MeshBin & out){
+	std::string cachePath = std::string(objPath) + ".meshbin";
+
+	MeshSourceKey key = {0, 0};
+	bool haveSource = statMeshSource(objPath, key);
+
+	MeshBin mesh;
+	if( mapFile(cachePath.c_str(), mesh.file) ){
+		if( bindMeshBin(mesh, mesh.file.data, mesh.file.size) ){
+			const MeshBinHeader & header = *mesh.header;
+			// Without its source, the cache is all we have
+			bool upToDate = !haveSource;
+			if( haveSource && header.sourceSize == key.size ){
+				uint64_t hash;
+				// A different mtime alone (checkout, copy...) doesn't mean a different mesh
+				upToDate = header.sourceMtime == key.mtime;
+				if( !upToDate && hashFile(objPath, hash) && hash == header.sourceHash ){
+					refreshMeshBinMtime(cachePath, key.mtime);
+					upToDate = true;
+				}
+			}
+			if( upToDate ){
+				printf("Loaded mesh cache %s\n", cachePath.c_str());
+				closeMeshBin(out);
+				out = std::move(mesh);
+				return true;
+			}
+		}
+		unmapFile(mesh.file);
+		mesh = MeshBin();
+	}
+
+	printf("Building mesh cache %s...\n", cachePath.c_str());
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	uint64_t hash;
+	if( !haveSource || !loadOBJ_indexed(objPath, indices, vertices, uvs, normals) || !hashFile(objPath, hash) )
+		return false;
+
+	// This only runs once per asset, so it's the place for the slow passes
+	VertexCacheStats before = analyzeVertexCache(indices, vertices.size());
+	optimizeVertexCache(indices, vertices.size());
+	std::vector<Meshlet> meshlets;
+	buildMeshlets(indices, vertices, meshlets); // Keeps most of the cache order
+	optimizeVertexFetch(indices, vertices, uvs, normals);
+	VertexCacheStats after = analyzeVertexCache(indices, vertices.size());
+	printf("Vertex cache : ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", before.acmr, after.acmr, before.atvr, after.atvr);
+
+	std::vector<MeshBinLod> lods;
+	buildMeshLods(indices, vertices, uvs, lods);
+
+	buildMeshBinImage(key, hash, indices, lods, meshlets, vertices, uvs, normals, mesh.image);
+	if( !writeMeshBinImage(cachePath, mesh.image) )
+		printf("Could not write %s, the mesh will be parsed again next time\n", cachePath.c_str());
+
+	// We already have the image in memory, no need to map what we just wrote
+	if( !bindMeshBin(mesh, mesh.image.data(), mesh.image.size()) )
+		return false;
+	closeMeshBin(out);
+	out = std::move(mesh); // Moving the vector keeps the pointers valid
+	return true;
+}
+
+void closeMeshBin(MeshBin & mesh){
+	unmapFile(mesh.file);
+	mesh = MeshBin();
+}
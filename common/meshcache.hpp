@@ -0,0 +1,111 @@
+#ifndef MESHCACHE_HPP
+#define MESHCACHE_HPP
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mappedfile.hpp"
+#include "vbomeshlets.hpp"
+
+// Binary mesh cache (.meshbin).
+//
+// The file starts with a MeshBinHeader, followed by one blob per attribute
+// and one for the 32-bit triangle indices. Every blob starts on a kMeshBinAlignment
+// boundary, so a pointer into the mapping can be handed to glBufferData as is.
+// The index blob holds every level of detail, finest first : each LOD is a
+// range of it, and they all index the same vertices. The full LOD is sorted
+// by meshlet, and the meshlet blob describes these ranges.
+// The header records the size, mtime and hash of the OBJ it was built from;
+// a cache that doesn't match its source is rebuilt.
+
+static const char     kMeshBinMagic[8] = {'M','E','S','H','B','I','N','\0'};
+static const uint32_t kMeshBinVersion = 5;
+static const uint32_t kMeshBinAlignment = 64;
+static const uint32_t kMeshBinMaxAttributes = 4;
+static const uint32_t kMeshBinMaxLods = 6;
+
+enum MeshBinSemantic {
+	MESHBIN_POSITION = 0,
+	MESHBIN_UV       = 1,
+	MESHBIN_NORMAL   = 2,
+};
+
+// Same values as the GL enums, so they can go straight to glVertexAttribPointer
+enum MeshBinComponentType {
+	MESHBIN_UNSIGNED_INT = 0x1405, // GL_UNSIGNED_INT
+	MESHBIN_FLOAT        = 0x1406, // GL_FLOAT
+};
+
+struct MeshBinBlob {
+	uint64_t offset; // from the start of the file
+	uint64_t size;   // in bytes
+};
+
+struct MeshBinAttribute {
+	uint32_t semantic;       // MeshBinSemantic
+	uint32_t componentType;  // MeshBinComponentType
+	uint32_t componentCount;
+	uint32_t stride;         // in bytes
+	MeshBinBlob data;
+};
+
+struct MeshBinLod {
+	uint32_t indexOffset;    // in indices, from the start of the index blob
+	uint32_t indexCount;
+	float    error;          // distance to the full mesh, in model units
+	uint32_t reserved;
+};
+
+struct MeshBinHeader {
+	char     magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+
+	// What the cache was built from
+	uint64_t sourceSize;
+	int64_t  sourceMtime;
+	uint64_t sourceHash;
+
+	uint32_t vertexCount;
+	uint32_t indexCount;     // All the LODs. 0 for a plain triangle list
+	uint32_t attributeCount;
+	uint32_t indexType;      // MeshBinComponentType
+	MeshBinAttribute attributes[kMeshBinMaxAttributes];
+	MeshBinBlob indices;
+	uint32_t lodCount;
+	uint32_t meshletCount;
+	MeshBinLod lods[kMeshBinMaxLods];
+	MeshBinBlob meshlets;    // Meshlet[meshletCount]
+};
+
+// A mesh read from a .meshbin file. The pointers point into the mapping
+// (or, right after a rebuild, into the in-memory image that was written
+// out) and stay valid until closeMeshBin.
+struct MeshBin {
+	MappedFile file;
+	std::vector<char> image;
+	const MeshBinHeader * header = nullptr;
+
+	unsigned int vertexCount = 0;
+	unsigned int indexCount = 0;
+	const glm::vec3 * positions = nullptr;
+	const glm::vec2 * uvs = nullptr;
+	const glm::vec3 * normals = nullptr;
+	const unsigned int * indices = nullptr; // nullptr if indexCount == 0
+	unsigned int lodCount = 0;
+	const MeshBinLod * lods = nullptr;      // lods[0] is the full mesh
+	unsigned int meshletCount = 0;
+	const Meshlet * meshlets = nullptr;     // ranges of lods[0]
+};
+
+// Maps "<objPath>.meshbin". If the sidecar is missing or doesn't match
+// the OBJ anymore, or is damaged (an index past the vertices...), the OBJ
+// is parsed and the sidecar (re)written first. On success, whatever out
+// held is closed.
+bool loadMeshBin(const char * objPath, MeshBin & out);
+
+void closeMeshBin(MeshBin & mesh);
+
+#endif
@@ -2,10 +2,16 @@
 #include <stdio.h>
 #include <string>
 #include <cstring>
+#include <charconv>
+#include <thread>
+#include <algorithm>
+#include <functional>
 
 #include <glm/glm.hpp>
 
 #include "objloader.hpp"
+#include "mappedfile.hpp"
+#include "jobsystem.hpp"
 
 // Very, VERY simple OBJ loader.
 // Here is a short list of features a real function would provide : 
@@ -17,7 +23,7 @@
 // - More secure. Change another line and you can inject code.
 // - Loading from memory, stream, etc
 
-bool loadOBJ(
+bool loadOBJ_slow(
 	const char * path, 
 	std::vector<glm::vec3> & out_vertices, 
 	std::vector<glm::vec2> & out_uvs,
@@ -111,6 +117,546 @@ bool loadOBJ(
 }
 
 
+
+// The loader below does the same job as loadOBJ_slow, but on a memory-mapped
+// file : no fscanf, no temporary strings, and every vector is reserved once
+// thanks to a first pass that only counts the records.
+
+struct ObjRecordCounts {
+	size_t vertices = 0;
+	size_t uvs = 0;
+	size_t normals = 0;
+	size_t faces = 0;
+};
+
+struct ObjRecords {
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
+};
+
+enum ObjRecordType { OBJ_OTHER, OBJ_VERTEX, OBJ_UV, OBJ_NORMAL, OBJ_FACE };
+
+static inline bool isBlank(char c){
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char * skipBlanks(const char * p, const char * end){
+	while( p < end && isBlank(*p) )
+		p++;
+	return p;
+}
+
+// Returns a pointer just past the next '\n' (or end)
+static inline const char * skipLine(const char * p, const char * end){
+	const char * eol = (const char *)memchr(p, '\n', end - p);
+	return eol ? eol + 1 : end;
+}
+
+// Reads the first word of the line, like fscanf("%s") did
+static inline ObjRecordType readRecordType(const char * & p, const char * end){
+	p = skipBlanks(p, end);
+	const char * word = p;
+	while( p < end && !isBlank(*p) && *p != '\n' )
+		p++;
+	size_t length = p - word;
+	if( length == 1 && word[0] == 'v' ) return OBJ_VERTEX;
+	if( length == 1 && word[0] == 'f' ) return OBJ_FACE;
+	if( length == 2 && word[0] == 'v' && word[1] == 't' ) return OBJ_UV;
+	if( length == 2 && word[0] == 'v' && word[1] == 'n' ) return OBJ_NORMAL;
+	return OBJ_OTHER;
+}
+
+// Returns nullptr if there is no number to read
+static inline const char * parseFloat(const char * p, const char * end, float & out){
+	p = skipBlanks(p, end);
+	if( p < end && *p == '+' ) // from_chars doesn't take the leading '+' that %f accepts
+		p++;
+	std::from_chars_result res = std::from_chars(p, end, out);
+	if( res.ec != std::errc() )
+		return nullptr;
+	return res.ptr;
+}
+
+static inline const char * parseIndex(const char * p, const char * end, unsigned int & out){
+	if( p == end || *p < '0' || *p > '9' )
+		return nullptr;
+	unsigned int value = 0;
+	while( p < end && *p >= '0' && *p <= '9' ){
+		value = value * 10 + (unsigned int)(*p - '0');
+		p++;
+	}
+	out = value;
+	return p;
+}
+
+// Reads a "v/vt/vn" triple
+static inline const char * parseFaceVertex(const char * p, const char * end, unsigned int & v, unsigned int & vt, unsigned int & vn){
+	p = parseIndex(skipBlanks(p, end), end, v);
+	if( p == nullptr || p == end || *p++ != '/' ) return nullptr;
+	p = parseIndex(p, end, vt);
+	if( p == nullptr || p == end || *p++ != '/' ) return nullptr;
+	return parseIndex(p, end, vn);
+}
+
+static void countObjRecords(const char * p, const char * end, ObjRecordCounts & counts){
+	while( p < end ){
+		switch( readRecordType(p, end) ){
+			case OBJ_VERTEX: counts.vertices++; break;
+			case OBJ_UV:     counts.uvs++;      break;
+			case OBJ_NORMAL: counts.normals++;  break;
+			case OBJ_FACE:   counts.faces++;    break;
+			default: break;
+		}
+		p = skipLine(p, end);
+	}
+}
+
+static void reserveObjRecords(ObjRecords & records, const ObjRecordCounts & counts){
+	records.vertices     .reserve(records.vertices.size() + counts.vertices);
+	records.uvs          .reserve(records.uvs.size() + counts.uvs);
+	records.normals      .reserve(records.normals.size() + counts.normals);
+	records.vertexIndices.reserve(records.vertexIndices.size() + 3 * counts.faces);
+	records.uvIndices    .reserve(records.uvIndices.size() + 3 * counts.faces);
+	records.normalIndices.reserve(records.normalIndices.size() + 3 * counts.faces);
+}
+
+// Parses complete lines in [p, end) and appends them to records
+static bool parseObjRecords(const char * p, const char * end, ObjRecords & records){
+	while( p < end ){
+		const char * line = p;
+		bool ok = true;
+		switch( readRecordType(p, end) ){
+			case OBJ_VERTEX: {
+				glm::vec3 vertex;
+				ok = (p = parseFloat(p, end, vertex.x)) && (p = parseFloat(p, end, vertex.y)) && (p = parseFloat(p, end, vertex.z));
+				if( ok )
+					records.vertices.push_back(vertex);
+				break;
+			}
+			case OBJ_UV: {
+				glm::vec2 uv;
+				ok = (p = parseFloat(p, end, uv.x)) && (p = parseFloat(p, end, uv.y));
+				if( ok ){
+					uv.y = -uv.y; // Same DDS convention as loadOBJ_slow
+					records.uvs.push_back(uv);
+				}
+				break;
+			}
+			case OBJ_NORMAL: {
+				glm::vec3 normal;
+				ok = (p = parseFloat(p, end, normal.x)) && (p = parseFloat(p, end, normal.y)) && (p = parseFloat(p, end, normal.z));
+				if( ok )
+					records.normals.push_back(normal);
+				break;
+			}
+			case OBJ_FACE: {
+				unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
+				for( int k=0; k<3 && ok; k++ )
+					ok = (p = parseFaceVertex(p, end, vertexIndex[k], uvIndex[k], normalIndex[k])) != nullptr;
+				for( int k=0; k<3 && ok; k++ ){
+					records.vertexIndices.push_back(vertexIndex[k]);
+					records.uvIndices    .push_back(uvIndex[k]);
+					records.normalIndices.push_back(normalIndex[k]);
+				}
+				break;
+			}
+			default:
+				// Probably a comment, eat up the rest of the line
+				break;
+		}
+		if( !ok ){
+			printf("File can't be read by our simple parser :-( Try exporting with other options\n");
+			printf("Offending line : %.*s\n", (int)(skipLine(line, end) - line), line);
+			return false;
+		}
+		p = skipLine(p, end);
+	}
+	return true;
+}
+
+// Checks the faces in [first, last) against the attribute counts
+static bool checkObjIndices(const ObjRecords & records, size_t first, size_t last){
+	for( size_t i=first; i<last; i++ ){
+		if( records.vertexIndices[i] - 1 >= records.vertices.size() ||
+			records.uvIndices[i]     - 1 >= records.uvs.size() ||
+			records.normalIndices[i] - 1 >= records.normals.size() ){
+			printf("Face %u references a vertex that doesn't exist\n", (unsigned int)(i / 3 + 1));
+			return false;
+		}
+	}
+	return true;
+}
+
+// For each vertex of the triangles in [first, last), put its attributes in
+// the output buffers, starting at out_xxx[0].
+// Indices must have been validated with checkObjIndices.
+static void expandObjRecords(
+	const ObjRecords & records,
+	size_t first, size_t last,
+	glm::vec3 * out_vertices,
+	glm::vec2 * out_uvs,
+	glm::vec3 * out_normals
+){
+	for( size_t i=first; i<last; i++ ){
+		out_vertices[i-first] = records.vertices[ records.vertexIndices[i]-1 ];
+		out_uvs     [i-first] = records.uvs     [ records.uvIndices[i]-1 ];
+		out_normals [i-first] = records.normals [ records.normalIndices[i]-1 ];
+	}
+}
+
+bool loadOBJ(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	printf("Loading OBJ file %s...\n", path);
+
+	MappedFile file;
+	if( !mapFile(path, file) ){
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		getchar();
+		return false;
+	}
+	const char * begin = file.data;
+	const char * end = file.data + file.size;
+
+	ObjRecordCounts counts;
+	countObjRecords(begin, end, counts);
+
+	ObjRecords records;
+	reserveObjRecords(records, counts);
+	if( !parseObjRecords(begin, end, records) || !checkObjIndices(records, 0, records.vertexIndices.size()) ){
+		unmapFile(file);
+		return false;
+	}
+
+	// Append, like loadOBJ_slow does
+	size_t count = records.vertexIndices.size();
+	size_t vertexOffset = out_vertices.size();
+	size_t uvOffset = out_uvs.size();
+	size_t normalOffset = out_normals.size();
+	out_vertices.resize(vertexOffset + count);
+	out_uvs     .resize(uvOffset + count);
+	out_normals .resize(normalOffset + count);
+	expandObjRecords(records, 0, count,
+		out_vertices.data() + vertexOffset,
+		out_uvs.data() + uvOffset,
+		out_normals.data() + normalOffset);
+
+	unmapFile(file);
+	return true;
+}
+
+
+template <typename T>
+static void appendChunk(std::vector<T> & dst, size_t offset, const std::vector<T> & src){
+	if( !src.empty() )
+		memcpy(dst.data() + offset, src.data(), src.size() * sizeof(T));
+}
+
+// Below this, spreading a file over more threads costs more than it saves
+static const size_t kMinObjChunkBytes = 1 << 20;
+
+// Threads worth starting for a file of this size : a small one is parsed
+// on the caller alone
+static unsigned int resolveObjThreadCount(unsigned int threadCount, size_t size){
+	if( threadCount == 0 )
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	return (unsigned int)std::min<size_t>(threadCount, std::max<size_t>(1, size / kMinObjChunkBytes));
+}
+
+// Parses [begin, end) into records, one chunk per thread of jobs
+static bool parseObjFileParallel(const char * begin, const char * end, JobSystem & jobs, ObjRecords & records){
+	size_t size = end - begin;
+	unsigned int chunkCount = jobs.getThreadCount();
+
+	// Split the file into chunks of whole lines. OBJ indices are global, so
+	// each chunk can be parsed on its own and the results simply
+	// concatenated in file order.
+	std::vector<const char *> bounds(chunkCount + 1);
+	bounds[0] = begin;
+	bounds[chunkCount] = end;
+	for( unsigned int k=1; k<chunkCount; k++ ){
+		const char * split = std::max(begin + size / chunkCount * k, bounds[k-1]);
+		bounds[k] = split > begin && split[-1] == '\n' ? split : skipLine(split, end);
+	}
+
+	if( chunkCount == 1 ){ // Nothing to merge
+		ObjRecordCounts counts;
+		countObjRecords(begin, end, counts);
+		reserveObjRecords(records, counts);
+		return parseObjRecords(begin, end, records);
+	}
+
+	std::vector<ObjRecords> chunks(chunkCount);
+	std::vector<char> parsed(chunkCount);
+	jobs.parallelFor(0, chunkCount, 1, [&](size_t first, size_t last){
+		for( size_t k=first; k<last; k++ ){
+			ObjRecordCounts counts;
+			countObjRecords(bounds[k], bounds[k+1], counts);
+			reserveObjRecords(chunks[k], counts);
+			parsed[k] = parseObjRecords(bounds[k], bounds[k+1], chunks[k]);
+		}
+	});
+	if( std::find(parsed.begin(), parsed.end(), 0) != parsed.end() )
+		return false;
+
+	// Merge the chunks in order, each thread copying its own chunk
+	struct ChunkOffsets { size_t vertices, uvs, normals, indices; };
+	std::vector<ChunkOffsets> offsets(chunkCount + 1);
+	offsets[0] = ChunkOffsets{0, 0, 0, 0};
+	for( unsigned int k=0; k<chunkCount; k++ ){
+		offsets[k+1].vertices = offsets[k].vertices + chunks[k].vertices.size();
+		offsets[k+1].uvs      = offsets[k].uvs      + chunks[k].uvs.size();
+		offsets[k+1].normals  = offsets[k].normals  + chunks[k].normals.size();
+		offsets[k+1].indices  = offsets[k].indices  + chunks[k].vertexIndices.size();
+	}
+	records.vertices     .resize(offsets[chunkCount].vertices);
+	records.uvs          .resize(offsets[chunkCount].uvs);
+	records.normals      .resize(offsets[chunkCount].normals);
+	records.vertexIndices.resize(offsets[chunkCount].indices);
+	records.uvIndices    .resize(offsets[chunkCount].indices);
+	records.normalIndices.resize(offsets[chunkCount].indices);
+	jobs.parallelFor(0, chunkCount, 1, [&](size_t first, size_t last){
+		for( size_t k=first; k<last; k++ ){
+			appendChunk(records.vertices,      offsets[k].vertices, chunks[k].vertices);
+			appendChunk(records.uvs,           offsets[k].uvs,      chunks[k].uvs);
+			appendChunk(records.normals,       offsets[k].normals,  chunks[k].normals);
+			appendChunk(records.vertexIndices, offsets[k].indices,  chunks[k].vertexIndices);
+			appendChunk(records.uvIndices,     offsets[k].indices,  chunks[k].uvIndices);
+			appendChunk(records.normalIndices, offsets[k].indices,  chunks[k].normalIndices);
+			chunks[k] = ObjRecords(); // Give the memory back early
+		}
+	});
+	chunks.clear();
+	return true;
+}
+
+bool loadOBJ_parallel(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount
+){
+	printf("Loading OBJ file %s...\n", path);
+
+	MappedFile file;
+	if( !mapFile(path, file) ){
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		getchar();
+		return false;
+	}
+	const char * begin = file.data;
+	const char * end = file.data + file.size;
+
+	JobSystem jobs(resolveObjThreadCount(threadCount, file.size));
+	ObjRecords records;
+	if( !parseObjFileParallel(begin, end, jobs, records) ){
+		unmapFile(file);
+		return false;
+	}
+
+	// Parallel gather. Every thread validates and expands its own range of
+	// face vertices, so the output is the same as the serial loader's.
+	size_t count = records.vertexIndices.size();
+	size_t vertexOffset = out_vertices.size();
+	size_t uvOffset = out_uvs.size();
+	size_t normalOffset = out_normals.size();
+	out_vertices.resize(vertexOffset + count);
+	out_uvs     .resize(uvOffset + count);
+	out_normals .resize(normalOffset + count);
+
+	unsigned int gatherCount = (unsigned int)std::min<size_t>(jobs.getThreadCount(), std::max<size_t>(1, count / (kMinObjChunkBytes / sizeof(glm::vec3))));
+	std::vector<char> gathered(gatherCount);
+	jobs.parallelFor(0, gatherCount, 1, [&](size_t firstChunk, size_t lastChunk){
+		for( size_t k=firstChunk; k<lastChunk; k++ ){
+			size_t first = count * k / gatherCount;
+			size_t last = count * (k + 1) / gatherCount;
+			gathered[k] = checkObjIndices(records, first, last);
+			if( gathered[k] )
+				expandObjRecords(records, first, last,
+					out_vertices.data() + vertexOffset + first,
+					out_uvs.data() + uvOffset + first,
+					out_normals.data() + normalOffset + first);
+		}
+	});
+	if( std::find(gathered.begin(), gathered.end(), 0) != gathered.end() ){
+		out_vertices.resize(vertexOffset);
+		out_uvs     .resize(uvOffset);
+		out_normals .resize(normalOffset);
+		unmapFile(file);
+		return false;
+	}
+
+	unmapFile(file);
+	return true;
+}
+
+
+bool loadOBJ_indexed(
+	const char * path,
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount
+){
+	printf("Loading OBJ file %s...\n", path);
+
+	MappedFile file;
+	if( !mapFile(path, file) ){
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		getchar();
+		return false;
+	}
+	ObjRecords records;
+	JobSystem jobs(resolveObjThreadCount(threadCount, file.size));
+	bool ok = parseObjFileParallel(file.data, file.data + file.size, jobs, records) &&
+	          checkObjIndices(records, 0, records.vertexIndices.size());
+	unmapFile(file);
+	if( !ok )
+		return false;
+
+	out_indices .clear();
+	out_vertices.clear();
+	out_uvs     .clear();
+	out_normals .clear();
+
+	// Deduplicating while parsing would tie the triple table to one thread,
+	// so the chunks are parsed in parallel first and the faces indexed here,
+	// in file order. Only the compact v/vt/vn/f records exist in between.
+	// Every output vertex is chained to the other output vertices that share
+	// its position, so finding a v/vt/vn triple only walks the (short) list
+	// of its position instead of hashing. It also keeps the lookups as local
+	// as the face indices themselves.
+	const unsigned int kNone = ~0u;
+	size_t count = records.vertexIndices.size();
+	std::vector<unsigned int> firstWithPosition(records.vertices.size(), kNone);
+	std::vector<unsigned int> nextWithPosition;
+	std::vector<unsigned int> uvOf, normalOf;
+	size_t expected = std::min(count, records.vertices.size() + records.uvs.size() + records.normals.size());
+	nextWithPosition.reserve(expected);
+	uvOf        .reserve(expected);
+	normalOf    .reserve(expected);
+	out_vertices.reserve(expected);
+	out_uvs     .reserve(expected);
+	out_normals .reserve(expected);
+
+	out_indices.resize(count);
+	for( size_t i=0; i<count; i++ ){
+		unsigned int v = records.vertexIndices[i] - 1;
+		unsigned int vt = records.uvIndices[i] - 1;
+		unsigned int vn = records.normalIndices[i] - 1;
+
+		unsigned int index = firstWithPosition[v];
+		while( index != kNone && (uvOf[index] != vt || normalOf[index] != vn) )
+			index = nextWithPosition[index];
+
+		if( index == kNone ){ // First time we see this corner, add it to the VBO
+			index = (unsigned int)out_vertices.size();
+			nextWithPosition.push_back(firstWithPosition[v]);
+			firstWithPosition[v] = index;
+			uvOf    .push_back(vt);
+			normalOf.push_back(vn);
+			out_vertices.push_back( records.vertices[v] );
+			out_uvs     .push_back( records.uvs[vt] );
+			out_normals .push_back( records.normals[vn] );
+		}
+		out_indices[i] = index;
+	}
+
+	printf("Indexed %u triangles into %u vertices\n", (unsigned int)(count / 3), (unsigned int)out_vertices.size());
+	return true;
+}
+
+// Size of the read buffer of streamOBJ. A single line can't be longer.
+static const size_t kObjStreamBufferBytes = 4 << 20;
+
+bool streamOBJ(
+	const char * path,
+	size_t trianglesPerBatch,
+	const std::function<void(const ObjTriangleBatch &)> & callback
+){
+	printf("Streaming OBJ file %s...\n", path);
+
+	FILE * file = fopen(path, "rb");
+	if( file == NULL ){
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		getchar();
+		return false;
+	}
+
+	// The attribute pools have to stay, any face can reference any earlier
+	// v/vt/vn. The face indices are only kept for the current block.
+	ObjRecords records;
+
+	size_t batchSize = 3 * std::max<size_t>(1, trianglesPerBatch);
+	std::vector<glm::vec3> batchVertices(batchSize);
+	std::vector<glm::vec2> batchUVs(batchSize);
+	std::vector<glm::vec3> batchNormals(batchSize);
+	size_t batchCount = 0;
+
+	std::vector<char> buffer(kObjStreamBufferBytes);
+	size_t pending = 0; // Bytes of an incomplete line carried over from the previous read
+	bool ok = true;
+	while( ok ){
+		size_t read = fread(buffer.data() + pending, 1, buffer.size() - pending, file);
+		bool atEnd = read == 0;
+		const char * begin = buffer.data();
+		const char * end = begin + pending + read;
+
+		// Only parse whole lines, unless there is nothing left to read
+		const char * blockEnd = end;
+		if( !atEnd ){
+			while( blockEnd > begin && blockEnd[-1] != '\n' )
+				blockEnd--;
+			if( blockEnd == begin ){
+				if( pending + read == buffer.size() ){
+					printf("Line longer than %u bytes, giving up\n", (unsigned int)buffer.size());
+					ok = false;
+				}
+				pending += read;
+				continue;
+			}
+		}
+
+		ok = parseObjRecords(begin, blockEnd, records) && checkObjIndices(records, 0, records.vertexIndices.size());
+
+		// Expand the faces of this block into batches
+		size_t faceVertexCount = ok ? records.vertexIndices.size() : 0;
+		for( size_t first=0; first<faceVertexCount; ){
+			size_t last = std::min(faceVertexCount, first + batchSize - batchCount);
+			expandObjRecords(records, first, last,
+				batchVertices.data() + batchCount,
+				batchUVs.data() + batchCount,
+				batchNormals.data() + batchCount);
+			batchCount += last - first;
+			first = last;
+			if( batchCount == batchSize ){
+				callback(ObjTriangleBatch{batchVertices.data(), batchUVs.data(), batchNormals.data(), batchCount});
+				batchCount = 0;
+			}
+		}
+		records.vertexIndices.clear();
+		records.uvIndices    .clear();
+		records.normalIndices.clear();
+
+		if( atEnd )
+			break;
+		pending = end - blockEnd;
+		memmove(buffer.data(), blockEnd, pending);
+	}
+	fclose(file);
+
+	if( ok && batchCount > 0 )
+		callback(ObjTriangleBatch{batchVertices.data(), batchUVs.data(), batchNormals.data(), batchCount});
+	return ok;
+}
+
 #ifdef USE_ASSIMP // don't use this #define, it's only for me (it AssImp fails to compile on your machine, at least all the other tutorials still work)
 
 // Include AssImp
@@ -1,6 +1,10 @@
 #ifndef OBJLOADER_H
 #define OBJLOADER_H
 
+#include <functional>
+
+// Memory-maps the file and parses it in place.
+// Appends the de-indexed triangles to the output vectors.
 bool loadOBJ(
 	const char * path, 
 	std::vector<glm::vec3> & out_vertices, 
@@ -8,6 +12,61 @@ bool loadOBJ(
 	std::vector<glm::vec3> & out_normals
 );
 
+// Same as loadOBJ, but the file is split into newline-aligned chunks that
+// are parsed on threadCount threads (0 = one per core), and the final
+// de-indexing gather runs in parallel too. The output is identical to
+// loadOBJ's. Small files are parsed on a single thread.
+bool loadOBJ_parallel(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs, 
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount = 0
+);
+
+// Indexed variant : every distinct v/vt/vn triple becomes one vertex, and
+// the faces reference them through 32-bit indices. The file is parsed on
+// threadCount threads like loadOBJ_parallel, then the triples are
+// deduplicated in one serial pass over the parsed face indices, without
+// building the de-indexed triangles. The outputs are replaced, not
+// appended to. Vertices come in order of first use.
+bool loadOBJ_indexed(
+	const char * path,
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount = 0
+);
+
+// A batch of de-indexed triangles, 3 vertices per triangle.
+// The pointers are only valid during the callback.
+struct ObjTriangleBatch {
+	const glm::vec3 * vertices;
+	const glm::vec2 * uvs;
+	const glm::vec3 * normals;
+	size_t vertexCount;
+};
+
+// Reads the file through a fixed-size buffer and hands out the triangles
+// in batches of trianglesPerBatch (the last one may be smaller). Only the
+// v/vt/vn pools and one batch are kept in memory, not the whole
+// de-indexed mesh. Faces may only reference attributes defined above them.
+bool streamOBJ(
+	const char * path,
+	size_t trianglesPerBatch,
+	const std::function<void(const ObjTriangleBatch &)> & callback
+);
+
+// Original fscanf-based loader. Same output as loadOBJ, kept as a reference
+// to compare against.
+bool loadOBJ_slow(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs, 
+	std::vector<glm::vec3> & out_normals
+);
+
 
 
 bool loadAssImp(
@@ -1,7 +1,15 @@
 #include <vector>
+#include <thread>
+#include <algorithm>
 #include <glm/glm.hpp>
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define TANGENTSPACE_SSE
+#endif
+
 #include "tangentspace.hpp"
+#include "jobsystem.hpp"
 
 void computeTangentBasis(
 	// inputs
@@ -71,3 +79,195 @@ void computeTangentBasis(
 }
 
 
+
+
+// 4 floats, one per triangle of a batch. Plain arrays when SSE isn't there.
+struct Float4 {
+#ifdef TANGENTSPACE_SSE
+	__m128 v;
+#else
+	float v[4];
+#endif
+};
+
+#ifdef TANGENTSPACE_SSE
+static inline Float4 load4(const float * p){ return { _mm_loadu_ps(p) }; }
+static inline void store4(float * p, Float4 a){ _mm_storeu_ps(p, a.v); }
+static inline Float4 operator+(Float4 a, Float4 b){ return { _mm_add_ps(a.v, b.v) }; }
+static inline Float4 operator-(Float4 a, Float4 b){ return { _mm_sub_ps(a.v, b.v) }; }
+static inline Float4 operator*(Float4 a, Float4 b){ return { _mm_mul_ps(a.v, b.v) }; }
+static inline Float4 operator/(Float4 a, Float4 b){ return { _mm_div_ps(a.v, b.v) }; }
+static inline Float4 sqrt4(Float4 a){ return { _mm_sqrt_ps(a.v) }; }
+static inline Float4 splat4(float x){ return { _mm_set1_ps(x) }; }
+// -value where sign < 0, value elsewhere
+static inline Float4 flipWhereNegative(Float4 value, Float4 sign){
+	__m128 negative = _mm_cmplt_ps(sign.v, _mm_setzero_ps());
+	return { _mm_xor_ps(value.v, _mm_and_ps(negative, _mm_set1_ps(-0.0f))) };
+}
+#else
+#define FLOAT4_OP(expr) Float4 r; for( int k=0; k<4; k++ ) r.v[k] = expr; return r;
+static inline Float4 load4(const float * p){ FLOAT4_OP(p[k]) }
+static inline void store4(float * p, Float4 a){ for( int k=0; k<4; k++ ) p[k] = a.v[k]; }
+static inline Float4 operator+(Float4 a, Float4 b){ FLOAT4_OP(a.v[k] + b.v[k]) }
+static inline Float4 operator-(Float4 a, Float4 b){ FLOAT4_OP(a.v[k] - b.v[k]) }
+static inline Float4 operator*(Float4 a, Float4 b){ FLOAT4_OP(a.v[k] * b.v[k]) }
+static inline Float4 operator/(Float4 a, Float4 b){ FLOAT4_OP(a.v[k] / b.v[k]) }
+static inline Float4 sqrt4(Float4 a){ FLOAT4_OP(sqrtf(a.v[k])) }
+static inline Float4 splat4(float x){ FLOAT4_OP(x) }
+static inline Float4 flipWhereNegative(Float4 value, Float4 sign){ FLOAT4_OP(sign.v[k] < 0.0f ? -value.v[k] : value.v[k]) }
+#undef FLOAT4_OP
+#endif
+
+// Per-corner and per-triangle results, one array per component.
+// Corner c of triangle t is at [c * stride + t], so the same corner of 4
+// consecutive triangles is contiguous.
+struct TangentStreams {
+	size_t stride;
+	std::vector<float> tangentX, tangentY, tangentZ;       // 3 * stride, orthogonalized
+	std::vector<float> bitangentX, bitangentY, bitangentZ; // stride
+};
+
+// Computes the tangents of triangles [first, first + 4)
+template <typename IndexType>
+static void computeTangentBatch(
+	const std::vector<IndexType> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	size_t first,
+	TangentStreams & streams
+){
+	// Gather the batch into SoA. Past the last triangle, repeat it : the
+	// results land in the padding of the streams and are never read.
+	size_t triangleCount = indices.size() / 3;
+	float px[3][4], py[3][4], pz[3][4], u[3][4], v[3][4], nx[3][4], ny[3][4], nz[3][4];
+	for( int k=0; k<4; k++ ){
+		size_t t = std::min(first + k, triangleCount - 1);
+		for( int c=0; c<3; c++ ){
+			IndexType i = indices[3 * t + c];
+			px[c][k] = vertices[i].x; py[c][k] = vertices[i].y; pz[c][k] = vertices[i].z;
+			u [c][k] = uvs[i].x;      v [c][k] = uvs[i].y;
+			nx[c][k] = normals[i].x;  ny[c][k] = normals[i].y;  nz[c][k] = normals[i].z;
+		}
+	}
+
+	// Edges of the triangle : position delta
+	Float4 p0x = load4(px[0]), p0y = load4(py[0]), p0z = load4(pz[0]);
+	Float4 e1x = load4(px[1]) - p0x, e1y = load4(py[1]) - p0y, e1z = load4(pz[1]) - p0z;
+	Float4 e2x = load4(px[2]) - p0x, e2y = load4(py[2]) - p0y, e2z = load4(pz[2]) - p0z;
+
+	// UV delta
+	Float4 u0 = load4(u[0]), v0 = load4(v[0]);
+	Float4 du1 = load4(u[1]) - u0, dv1 = load4(v[1]) - v0;
+	Float4 du2 = load4(u[2]) - u0, dv2 = load4(v[2]) - v0;
+
+	Float4 r = splat4(1.0f) / (du1 * dv2 - dv1 * du2);
+	Float4 tx = (e1x * dv2 - e2x * dv1) * r;
+	Float4 ty = (e1y * dv2 - e2y * dv1) * r;
+	Float4 tz = (e1z * dv2 - e2z * dv1) * r;
+	Float4 bx = (e2x * du1 - e1x * du2) * r;
+	Float4 by = (e2y * du1 - e1y * du2) * r;
+	Float4 bz = (e2z * du1 - e1z * du2) * r;
+	store4(&streams.bitangentX[first], bx);
+	store4(&streams.bitangentY[first], by);
+	store4(&streams.bitangentZ[first], bz);
+
+	for( int c=0; c<3; c++ ){
+		Float4 n_x = load4(nx[c]), n_y = load4(ny[c]), n_z = load4(nz[c]);
+
+		// Gram-Schmidt orthogonalize
+		Float4 d = n_x * tx + n_y * ty + n_z * tz;
+		Float4 ox = tx - n_x * d, oy = ty - n_y * d, oz = tz - n_z * d;
+		Float4 inverseLength = splat4(1.0f) / sqrt4(ox * ox + oy * oy + oz * oz);
+		ox = ox * inverseLength; oy = oy * inverseLength; oz = oz * inverseLength;
+
+		// Calculate handedness
+		Float4 handedness =
+			(n_y * oz - n_z * oy) * bx +
+			(n_z * ox - n_x * oz) * by +
+			(n_x * oy - n_y * ox) * bz;
+		size_t corner = c * streams.stride + first;
+		store4(&streams.tangentX[corner], flipWhereNegative(ox, handedness));
+		store4(&streams.tangentY[corner], flipWhereNegative(oy, handedness));
+		store4(&streams.tangentZ[corner], flipWhereNegative(oz, handedness));
+	}
+}
+
+// Below this, spreading the work over more threads costs more than it saves
+static const size_t kMinTangentChunkTriangles = 1 << 14;
+
+template <typename IndexType>
+void computeTangentBasis_indexed(
+	// inputs
+	const std::vector<IndexType> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	// outputs
+	std::vector<glm::vec3> & tangents,
+	std::vector<glm::vec3> & bitangents,
+	unsigned int threadCount
+){
+	size_t triangleCount = indices.size() / 3;
+	size_t vertexCount = vertices.size();
+	tangents.assign(vertexCount, glm::vec3(0.0f));
+	bitangents.assign(vertexCount, glm::vec3(0.0f));
+	if( triangleCount == 0 )
+		return;
+
+	if( threadCount == 0 )
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	unsigned int chunkCount = (unsigned int)std::min<size_t>(threadCount, std::max<size_t>(1, triangleCount / kMinTangentChunkTriangles));
+	JobSystem jobs(chunkCount);
+
+	// Per-triangle math, each job on its own range of batches
+	TangentStreams streams;
+	streams.stride = (triangleCount + 3) & ~(size_t)3;
+	streams.tangentX.resize(3 * streams.stride);
+	streams.tangentY.resize(3 * streams.stride);
+	streams.tangentZ.resize(3 * streams.stride);
+	streams.bitangentX.resize(streams.stride);
+	streams.bitangentY.resize(streams.stride);
+	streams.bitangentZ.resize(streams.stride);
+	size_t batchCount = streams.stride / 4;
+	jobs.parallelFor(0, batchCount, (batchCount + chunkCount - 1) / chunkCount, [&](size_t begin, size_t end){
+		for( size_t batch=begin; batch<end; batch++ )
+			computeTangentBatch(indices, vertices, uvs, normals, batch * 4, streams);
+	});
+
+	// The corners of each vertex, in triangle order (counting sort)
+	std::vector<unsigned int> firstCorner(vertexCount + 1, 0);
+	for( size_t i=0; i<indices.size(); i++ )
+		firstCorner[indices[i] + 1]++;
+	for( size_t v=0; v<vertexCount; v++ )
+		firstCorner[v + 1] += firstCorner[v];
+	std::vector<unsigned int> corners(indices.size());
+	{
+		std::vector<unsigned int> cursor(firstCorner.begin(), firstCorner.end() - 1);
+		for( size_t i=0; i<indices.size(); i++ )
+			corners[cursor[indices[i]]++] = (unsigned int)i;
+	}
+
+	// Sum the corners of each vertex. Every job owns a range of vertices
+	// and always adds in the same order : deterministic.
+	jobs.parallelFor(0, vertexCount, (vertexCount + chunkCount - 1) / chunkCount, [&](size_t begin, size_t end){
+		for( size_t v=begin; v<end; v++ ){
+			glm::vec3 t(0.0f), b(0.0f);
+			for( unsigned int j=firstCorner[v]; j<firstCorner[v + 1]; j++ ){
+				size_t triangle = corners[j] / 3;
+				size_t corner = (corners[j] % 3) * streams.stride + triangle;
+				t += glm::vec3(streams.tangentX[corner], streams.tangentY[corner], streams.tangentZ[corner]);
+				b += glm::vec3(streams.bitangentX[triangle], streams.bitangentY[triangle], streams.bitangentZ[triangle]);
+			}
+			tangents[v] = t;
+			bitangents[v] = b;
+		}
+	});
+}
+
+template void computeTangentBasis_indexed<unsigned short>(
+	const std::vector<unsigned short> &, const std::vector<glm::vec3> &, const std::vector<glm::vec2> &, const std::vector<glm::vec3> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec3> &, unsigned int);
+template void computeTangentBasis_indexed<unsigned int>(
+	const std::vector<unsigned int> &, const std::vector<glm::vec3> &, const std::vector<glm::vec2> &, const std::vector<glm::vec3> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec3> &, unsigned int);
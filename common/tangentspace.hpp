@@ -11,5 +11,29 @@ void computeTangentBasis(
 	std::vector<glm::vec3> & bitangents
 );
 
+// Indexed variant : one tangent and one bitangent per index entry, i.e. the
+// corners sharing a vertex are summed. That is what indexVBO_TBN does to the
+// output of computeTangentBasis only when the input indexing already matches
+// its weld (corners equal in position, uv and normal share a vertex, and no
+// others do); otherwise the two differ. Each corner's tangent is
+// orthogonalized against its normal and flipped by its handedness, then the
+// corners of a vertex are summed in triangle order,
+// so the result doesn't depend on threadCount (0 = one per core).
+// The per-triangle math runs on 4 triangles at a time, with SSE when the
+// compiler targets it. The outputs are replaced, not appended to.
+// IndexType is unsigned short or unsigned int.
+template <typename IndexType>
+void computeTangentBasis_indexed(
+	// inputs
+	const std::vector<IndexType> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	// outputs
+	std::vector<glm::vec3> & tangents,
+	std::vector<glm::vec3> & bitangents,
+	unsigned int threadCount = 0
+);
+
 
 #endif
\ No newline at end of file
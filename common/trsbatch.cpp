@@ -0,0 +1,121 @@
+#include <vector>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRSBATCH_SSE
+#endif
+
+#include "trsbatch.hpp"
+
+void resizeTrsArrays(TrsArrays & arrays, size_t count){
+	arrays.x.resize(count);
+	arrays.y.resize(count);
+	arrays.z.resize(count);
+	arrays.angles.resize(count);
+	arrays.scales.resize(count);
+}
+
+static inline void setTrsMatrix(AffineMatrix & m, float x, float y, float z, float c, float s, float scale){
+	m.rows[0][0] = c * scale; m.rows[0][1] = -s * scale; m.rows[0][2] = 0.0f;  m.rows[0][3] = x;
+	m.rows[1][0] = s * scale; m.rows[1][1] =  c * scale; m.rows[1][2] = 0.0f;  m.rows[1][3] = y;
+	m.rows[2][0] = 0.0f;      m.rows[2][1] = 0.0f;       m.rows[2][2] = scale; m.rows[2][3] = z;
+}
+
+void buildTrsMatrices_scalar(const TrsArrays & in, std::vector<AffineMatrix> & out){
+	size_t count = in.x.size();
+	out.resize(count);
+	for ( size_t i=0; i<count; i++ )
+		setTrsMatrix(out[i], in.x[i], in.y[i], in.z[i], cosf(in.angles[i]), sinf(in.angles[i]), in.scales[i]);
+}
+
+#ifdef TRSBATCH_SSE
+
+// sin(x) for x in [-pi/2, pi/2] : Taylor series up to x^11
+static inline __m128 sinHalfPi4(__m128 x){
+	__m128 x2 = _mm_mul_ps(x, x);
+	__m128 p = _mm_set1_ps(-2.5052108e-8f);
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps( 2.7557319e-6f));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-1.9841270e-4f));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps( 8.3333333e-3f));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-1.6666667e-1f));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(1.0f));
+	return _mm_mul_ps(p, x);
+}
+
+// Brings x into [-pi, pi], then folds it into [-pi/2, pi/2] where the sine
+// is the same : sin(x) = sin(pi - x) = sin(-pi - x)
+static inline __m128 sin4(__m128 x){
+	const __m128 twoPi = _mm_set1_ps(6.28318531f);
+	const __m128 pi = _mm_set1_ps(3.14159265f);
+	const __m128 halfPi = _mm_set1_ps(1.57079633f);
+	__m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.159154943f))));
+	x = _mm_sub_ps(x, _mm_mul_ps(turns, twoPi));
+	__m128 above = _mm_cmpgt_ps(x, halfPi);
+	__m128 below = _mm_cmplt_ps(x, _mm_sub_ps(_mm_setzero_ps(), halfPi));
+	__m128 sign = _mm_and_ps(x, _mm_set1_ps(-0.0f));
+	// pi - x or -pi - x : copysign(pi, x) - x
+	__m128 folded = _mm_sub_ps(_mm_or_ps(pi, sign), x);
+	__m128 outside = _mm_or_ps(above, below);
+	x = _mm_or_ps(_mm_and_ps(outside, folded), _mm_andnot_ps(outside, x));
+	return sinHalfPi4(x);
+}
+
+// 4 rows of 4 floats in, the same floats column by column out
+static inline void storeTransposed(__m128 a, __m128 b, __m128 c, __m128 d, float * row0, float * row1, float * row2, float * row3){
+	_MM_TRANSPOSE4_PS(a, b, c, d);
+	_mm_storeu_ps(row0, a);
+	_mm_storeu_ps(row1, b);
+	_mm_storeu_ps(row2, c);
+	_mm_storeu_ps(row3, d);
+}
+
+void buildTrsMatrices(const TrsArrays & in, std::vector<AffineMatrix> & out){
+	size_t count = in.x.size();
+	out.resize(count);
+	const __m128 halfPi = _mm_set1_ps(1.57079633f);
+	const __m128 zero = _mm_setzero_ps();
+
+	size_t i = 0;
+	for ( ; i + 4 <= count; i += 4 ){
+		__m128 angle = _mm_loadu_ps(&in.angles[i]);
+		__m128 scale = _mm_loadu_ps(&in.scales[i]);
+		__m128 s = _mm_mul_ps(sin4(angle), scale);
+		__m128 c = _mm_mul_ps(sin4(_mm_add_ps(angle, halfPi)), scale);
+		__m128 minusS = _mm_sub_ps(zero, s);
+
+		// Each row of the 4 matrices is built as 4 columns, then transposed
+		for ( int r=0; r<3; r++ ){
+			__m128 c0, c1, c2, c3;
+			if ( r == 0 ){ c0 = c;    c1 = minusS; c2 = zero;  c3 = _mm_loadu_ps(&in.x[i]); }
+			else if ( r == 1 ){ c0 = s; c1 = c;  c2 = zero;  c3 = _mm_loadu_ps(&in.y[i]); }
+			else {       c0 = zero; c1 = zero;   c2 = scale; c3 = _mm_loadu_ps(&in.z[i]); }
+			storeTransposed(c0, c1, c2, c3, out[i].rows[r], out[i+1].rows[r], out[i+2].rows[r], out[i+3].rows[r]);
+		}
+	}
+	// Leftovers
+	for ( ; i<count; i++ )
+		setTrsMatrix(out[i], in.x[i], in.y[i], in.z[i], cosf(in.angles[i]), sinf(in.angles[i]), in.scales[i]);
+}
+
+#else
+
+void buildTrsMatrices(const TrsArrays & in, std::vector<AffineMatrix> & out){
+	buildTrsMatrices_scalar(in, out);
+}
+
+#endif
+
+glm::vec3 inverseTransformTrs(const AffineMatrix & m, const glm::vec3 & point){
+	// The 3x3 part is a rotation times scale : its inverse is its
+	// transpose divided by scale^2
+	glm::vec3 d(point.x - m.rows[0][3], point.y - m.rows[1][3], point.z - m.rows[2][3]);
+	float scale2 = m.rows[0][0] * m.rows[0][0] + m.rows[1][0] * m.rows[1][0] + m.rows[2][0] * m.rows[2][0];
+	return glm::vec3(
+		m.rows[0][0] * d.x + m.rows[1][0] * d.y + m.rows[2][0] * d.z,
+		m.rows[0][1] * d.x + m.rows[1][1] * d.y + m.rows[2][1] * d.z,
+		m.rows[0][2] * d.x + m.rows[1][2] * d.y + m.rows[2][2] * d.z
+	) / scale2;
+}
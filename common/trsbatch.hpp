@@ -0,0 +1,36 @@
+#ifndef TRSBATCH_HPP
+#define TRSBATCH_HPP
+
+// Model matrices of objects that are only translated, spun around Z and
+// uniformly scaled : translate(position) * rotate(angle, Z) * scale(scale),
+// the way glm builds them, without the three 4x4 matrices and the two 4x4
+// products per object.
+
+// The top 3 rows of a 4x4 affine matrix, row by row. The last row is
+// always (0, 0, 0, 1). Upload it with glUniformMatrix4x3fv(..., GL_TRUE, ...)
+// into a GLSL mat4x3.
+struct AffineMatrix {
+	float rows[3][4];
+};
+
+// One array per field, one entry per object
+struct TrsArrays {
+	std::vector<float> x, y, z;
+	std::vector<float> angles;
+	std::vector<float> scales;
+};
+
+void resizeTrsArrays(TrsArrays & arrays, size_t count);
+
+// out[i] = translate(x, y, z) * rotate(angle, Z) * scale(scale), 4 objects
+// at a time with SSE when the compiler targets it. The sines and cosines
+// come from a polynomial, within 2e-6 of sinf / cosf.
+void buildTrsMatrices(const TrsArrays & in, std::vector<AffineMatrix> & out);
+
+// Same result, one object at a time with sinf / cosf
+void buildTrsMatrices_scalar(const TrsArrays & in, std::vector<AffineMatrix> & out);
+
+// Where point lands in the object's own space, i.e. inverse(matrix) * point
+glm::vec3 inverseTransformTrs(const AffineMatrix & matrix, const glm::vec3 & point);
+
+#endif
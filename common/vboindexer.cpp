@@ -1,5 +1,8 @@
 #include <vector>
 #include <map>
+#include <limits>
+#include <stdio.h>
+#include <math.h>
 
 #include <glm/glm.hpp>
 
@@ -97,7 +100,9 @@ bool getSimilarVertexIndex_fast(
 	}
 }
 
-void indexVBO(
+// Previous implementation, kept for comparison : O(n log n), one node
+// allocation per vertex, and 16-bit indices only.
+void indexVBO_map(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
@@ -133,45 +138,269 @@ void indexVBO(
 }
 
 
+// Hashes the raw bits, so that it agrees with the memcmp comparison above
+static inline unsigned int hashPackedVertex(const PackedVertex & packed){
+	unsigned int words[sizeof(PackedVertex) / sizeof(unsigned int)];
+	memcpy(words, &packed, sizeof(words));
+	unsigned int h = 2166136261u;
+	for ( unsigned int i=0; i<sizeof(words)/sizeof(words[0]); i++ ){
+		h = (h ^ words[i]) * 16777619u;
+		h ^= h >> 15;
+	}
+	// Murmur3 finalizer, the low bits pick the slot
+	h ^= h >> 16; h *= 0x85ebca6bu;
+	h ^= h >> 13; h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
 
+// One slot of the open addressing table. The hash is kept next to the
+// index so that most probes never have to look at the vertex itself.
+struct VertexSlot {
+	unsigned int hash;
+	unsigned int index; // ~0u = empty
+};
 
+template <typename IndexType>
+bool indexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
 
+	std::vector<IndexType> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	const unsigned int kEmpty = ~0u;
+	const size_t maxVertices = (size_t)std::numeric_limits<IndexType>::max() + 1;
 
+	// Reserve everything up front. The table is at most half full, since
+	// there can't be more distinct vertices than input vertices.
+	size_t capacity = 16;
+	while ( capacity < 2 * in_vertices.size() )
+		capacity *= 2;
+	size_t mask = capacity - 1;
+	std::vector<VertexSlot> slots(capacity, VertexSlot{0, kEmpty});
+	out_indices .reserve(out_indices.size() + in_vertices.size());
+	out_vertices.reserve(out_vertices.size() + in_vertices.size());
+	out_uvs     .reserve(out_uvs.size() + in_vertices.size());
+	out_normals .reserve(out_normals.size() + in_vertices.size());
 
-void indexVBO_TBN(
+	// For each input vertex
+	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
+
+		PackedVertex packed = {in_vertices[i], in_uvs[i], in_normals[i]};
+		unsigned int hash = hashPackedVertex(packed);
+
+		// Try to find a similar vertex in out_XXXX
+		size_t slot = hash & mask;
+		while ( slots[slot].index != kEmpty ){
+			if ( slots[slot].hash == hash ){
+				size_t k = slots[slot].index;
+				if ( memcmp(&out_vertices[k], &packed.position, sizeof(glm::vec3)) == 0 &&
+				     memcmp(&out_uvs     [k], &packed.uv,       sizeof(glm::vec2)) == 0 &&
+				     memcmp(&out_normals [k], &packed.normal,   sizeof(glm::vec3)) == 0 )
+					break;
+			}
+			slot = (slot + 1) & mask;
+		}
+
+		if ( slots[slot].index != kEmpty ){ // A similar vertex is already in the VBO, use it instead !
+			out_indices.push_back( (IndexType)slots[slot].index );
+		}else{ // If not, it needs to be added in the output data.
+			size_t newindex = out_vertices.size();
+			if ( newindex >= maxVertices ){
+				printf("indexVBO : more than %u vertices, use 32-bit indices\n", (unsigned int)(maxVertices - 1));
+				return false;
+			}
+			out_vertices.push_back( in_vertices[i]);
+			out_uvs     .push_back( in_uvs[i]);
+			out_normals .push_back( in_normals[i]);
+			out_indices .push_back( (IndexType)newindex );
+			slots[slot].hash = hash;
+			slots[slot].index = (unsigned int)newindex;
+		}
+	}
+	return true;
+}
+
+template bool indexVBO<unsigned short>(
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &,
+	std::vector<unsigned short> &, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+template bool indexVBO<unsigned int>(
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &,
+	std::vector<unsigned int> &, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+
+// The unique vertex count is only known once they are merged : index with
+// 32 bits, then narrow if everything fits in 16
+static void pickIndexWidth(VboIndexBuffer & out_indices, size_t vertexCount){
+	out_indices.wide = vertexCount > (size_t)std::numeric_limits<unsigned short>::max() + 1;
+	if ( !out_indices.wide ){
+		out_indices.indices16.assign(out_indices.indices32.begin(), out_indices.indices32.end());
+		std::vector<unsigned int>().swap(out_indices.indices32);
+	}
+}
+
+void indexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	VboIndexBuffer & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	out_indices = VboIndexBuffer();
+	out_vertices.clear();
+	out_uvs     .clear();
+	out_normals .clear();
+	indexVBO(in_vertices, in_uvs, in_normals, out_indices.indices32, out_vertices, out_uvs, out_normals);
+	pickIndexWidth(out_indices, out_vertices.size());
+}
+
+
+
+
+
+
+
+// Spatial hash used to find welding candidates for indexVBO_TBN.
+// Cells are twice as large as the is_near tolerance : two positions that
+// are near each other are always in the same or in adjacent cells.
+static const float kWeldCellSize = 0.02f;
+
+static inline long long weldCell(float x){
+	return (long long)floorf(x * (1.0f / kWeldCellSize));
+}
+
+static inline size_t hashWeldCell(long long x, long long y, long long z){
+	unsigned long long h = (unsigned long long)x * 73856093ull ^ (unsigned long long)y * 19349663ull ^ (unsigned long long)z * 83492791ull;
+	h ^= h >> 29; h *= 0xbf58476d1ce4e5b9ull;
+	h ^= h >> 32;
+	return (size_t)h;
+}
+
+template <typename IndexType>
+bool indexVBO_TBN(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
 	std::vector<glm::vec3> & in_tangents,
 	std::vector<glm::vec3> & in_bitangents,
 
-	std::vector<unsigned short> & out_indices,
+	std::vector<IndexType> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals,
 	std::vector<glm::vec3> & out_tangents,
 	std::vector<glm::vec3> & out_bitangents
 ){
+	const unsigned int kNone = ~0u;
+	const size_t maxVertices = (size_t)std::numeric_limits<IndexType>::max() + 1;
+
+	// Buckets of the spatial hash, chained through the output vertices
+	size_t bucketCount = 16;
+	while ( bucketCount < 2 * (out_vertices.size() + in_vertices.size()) )
+		bucketCount *= 2;
+	size_t mask = bucketCount - 1;
+	std::vector<unsigned int> firstInBucket(bucketCount, kNone);
+	std::vector<unsigned int> nextInBucket;
+	nextInBucket.reserve(out_vertices.size() + in_vertices.size());
+	out_indices.reserve(out_indices.size() + in_vertices.size());
+
+	// Like the linear search, also weld to what is already in out_XXXX
+	for ( unsigned int k=0; k<out_vertices.size(); k++ ){
+		size_t bucket = hashWeldCell(weldCell(out_vertices[k].x), weldCell(out_vertices[k].y), weldCell(out_vertices[k].z)) & mask;
+		nextInBucket.push_back(firstInBucket[bucket]);
+		firstInBucket[bucket] = k;
+	}
+
 	// For each input vertex
 	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
+		glm::vec3 & position = in_vertices[i];
+		long long cx = weldCell(position.x), cy = weldCell(position.y), cz = weldCell(position.z);
 
-		// Try to find a similar vertex in out_XXXX
-		unsigned short index;
-		bool found = getSimilarVertexIndex(in_vertices[i], in_uvs[i], in_normals[i],     out_vertices, out_uvs, out_normals, index);
+		// Look for a similar vertex in the neighbouring cells. Keep the
+		// oldest one, it's the one a linear search would have found.
+		unsigned int index = kNone;
+		for ( long long dx=-1; dx<=1; dx++ )
+		for ( long long dy=-1; dy<=1; dy++ )
+		for ( long long dz=-1; dz<=1; dz++ ){
+			size_t bucket = hashWeldCell(cx+dx, cy+dy, cz+dz) & mask;
+			for ( unsigned int k=firstInBucket[bucket]; k!=kNone; k=nextInBucket[k] ){
+				if ( k < index &&
+					is_near( position.x     , out_vertices[k].x ) &&
+					is_near( position.y     , out_vertices[k].y ) &&
+					is_near( position.z     , out_vertices[k].z ) &&
+					is_near( in_uvs[i].x    , out_uvs     [k].x ) &&
+					is_near( in_uvs[i].y    , out_uvs     [k].y ) &&
+					is_near( in_normals[i].x, out_normals [k].x ) &&
+					is_near( in_normals[i].y, out_normals [k].y ) &&
+					is_near( in_normals[i].z, out_normals [k].z )
+				){
+					index = k;
+				}
+			}
+		}
 
-		if ( found ){ // A similar vertex is already in the VBO, use it instead !
-			out_indices.push_back( index );
+		if ( index != kNone ){ // A similar vertex is already in the VBO, use it instead !
+			out_indices.push_back( (IndexType)index );
 
 			// Average the tangents and the bitangents
 			out_tangents[index] += in_tangents[i];
 			out_bitangents[index] += in_bitangents[i];
 		}else{ // If not, it needs to be added in the output data.
+			size_t newindex = out_vertices.size();
+			if ( newindex >= maxVertices ){
+				printf("indexVBO_TBN : more than %u vertices, use 32-bit indices\n", (unsigned int)(maxVertices - 1));
+				return false;
+			}
 			out_vertices.push_back( in_vertices[i]);
 			out_uvs     .push_back( in_uvs[i]);
 			out_normals .push_back( in_normals[i]);
 			out_tangents .push_back( in_tangents[i]);
 			out_bitangents .push_back( in_bitangents[i]);
-			out_indices .push_back( (unsigned short)out_vertices.size() - 1 );
+			out_indices .push_back( (IndexType)newindex );
+
+			size_t bucket = hashWeldCell(cx, cy, cz) & mask;
+			nextInBucket.push_back(firstInBucket[bucket]);
+			firstInBucket[bucket] = (unsigned int)newindex;
 		}
 	}
+	return true;
 }
+
+template bool indexVBO_TBN<unsigned short>(
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &, std::vector<glm::vec3> &, std::vector<glm::vec3> &,
+	std::vector<unsigned short> &, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &, std::vector<glm::vec3> &, std::vector<glm::vec3> &);
+template bool indexVBO_TBN<unsigned int>(
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &, std::vector<glm::vec3> &, std::vector<glm::vec3> &,
+	std::vector<unsigned int> &, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &, std::vector<glm::vec3> &, std::vector<glm::vec3> &);
+
+void indexVBO_TBN(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	std::vector<glm::vec3> & in_tangents,
+	std::vector<glm::vec3> & in_bitangents,
+
+	VboIndexBuffer & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> & out_tangents,
+	std::vector<glm::vec3> & out_bitangents
+){
+	out_indices = VboIndexBuffer();
+	out_vertices  .clear();
+	out_uvs       .clear();
+	out_normals   .clear();
+	out_tangents  .clear();
+	out_bitangents.clear();
+	indexVBO_TBN(in_vertices, in_uvs, in_normals, in_tangents, in_bitangents,
+		out_indices.indices32, out_vertices, out_uvs, out_normals, out_tangents, out_bitangents);
+	pickIndexWidth(out_indices, out_vertices.size());
+}
+
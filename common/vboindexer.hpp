@@ -1,11 +1,54 @@
 #ifndef VBOINDEXER_HPP
 #define VBOINDEXER_HPP
 
+// Merges identical vertices with a flat hash table.
+// IndexType is unsigned short or unsigned int. Meshes with more than 65536
+// input vertices may not fit in 16-bit indices : in that case this returns
+// false and the outputs are incomplete, so use unsigned int for them.
+template <typename IndexType>
+bool indexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	std::vector<IndexType> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+);
+
+// Indices whose width is picked by the indexer : 16 bits when every vertex
+// fits, 32 bits otherwise. Only the vector of that width is filled.
+struct VboIndexBuffer {
+	bool wide = false;
+	std::vector<unsigned short> indices16;
+	std::vector<unsigned int> indices32;
+
+	size_t size() const { return wide ? indices32.size() : indices16.size(); }
+	const void * data() const { return wide ? (const void *)indices32.data() : (const void *)indices16.data(); }
+	size_t indexSize() const { return wide ? sizeof(unsigned int) : sizeof(unsigned short); }
+};
+
+// indexVBO with the index width chosen from the number of unique vertices.
+// The outputs are replaced, not appended to.
 void indexVBO(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
 
+	VboIndexBuffer & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+);
+
+// The std::map implementation indexVBO replaced. 16-bit indices only, they
+// wrap past 65535 vertices. Kept to benchmark against.
+void indexVBO_map(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
 	std::vector<unsigned short> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
@@ -13,6 +56,28 @@ void indexVBO(
 );
 
 
+// Merges vertices that are equal up to a 0.01 tolerance, and averages
+// their tangents and bitangents. Similar vertices are found through a
+// spatial hash on the position instead of a linear search, and the result
+// is the same as the linear search's. Same IndexType rules as indexVBO.
+template <typename IndexType>
+bool indexVBO_TBN(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	std::vector<glm::vec3> & in_tangents,
+	std::vector<glm::vec3> & in_bitangents,
+
+	std::vector<IndexType> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> & out_tangents,
+	std::vector<glm::vec3> & out_bitangents
+);
+
+// indexVBO_TBN with the index width chosen from the number of unique
+// vertices. The outputs are replaced, not appended to.
 void indexVBO_TBN(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
@@ -20,7 +85,7 @@ void indexVBO_TBN(
 	std::vector<glm::vec3> & in_tangents,
 	std::vector<glm::vec3> & in_bitangents,
 
-	std::vector<unsigned short> & out_indices,
+	VboIndexBuffer & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals,
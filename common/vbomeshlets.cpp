@@ -0,0 +1,299 @@
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+#include <float.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "vbomeshlets.hpp"
+
+// How much a triangle facing away from the meshlet's average normal costs,
+// compared to a new vertex. Higher gives tighter cones but more meshlets.
+static const float kMeshletConeWeight = 0.5f;
+
+// Triangles looked at around each position of the meshlet. A few more than
+// a usual valence; only matters for positions shared by many triangles.
+static const unsigned int kMeshletMaxNeighbours = 16;
+
+// Adds the meshlet made of the last triangles written, with its bounds
+static void appendMeshlet(
+	std::vector<Meshlet> & meshlets,
+	size_t indexEnd,
+	const std::vector<unsigned int> & meshletVertices,
+	const std::vector<unsigned int> & meshletTriangles,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec3> & triangleNormals
+){
+	Meshlet meshlet;
+	meshlet.indexOffset = (unsigned int)(indexEnd - meshletTriangles.size() * 3);
+	meshlet.triangleCount = (unsigned int)meshletTriangles.size();
+	meshlet.vertexCount = (unsigned int)meshletVertices.size();
+	meshlet.reserved = 0;
+
+	glm::vec3 lower = vertices[ meshletVertices[0] ];
+	glm::vec3 upper = lower;
+	for ( size_t i=1; i<meshletVertices.size(); i++ ){
+		lower = glm::min(lower, vertices[ meshletVertices[i] ]);
+		upper = glm::max(upper, vertices[ meshletVertices[i] ]);
+	}
+	meshlet.center = (lower + upper) * 0.5f;
+	meshlet.radius = 0.0f;
+	for ( size_t i=0; i<meshletVertices.size(); i++ )
+		meshlet.radius = std::max(meshlet.radius, glm::length(vertices[ meshletVertices[i] ] - meshlet.center));
+
+	glm::vec3 normalSum(0.0f);
+	for ( size_t i=0; i<meshletTriangles.size(); i++ )
+		normalSum += triangleNormals[ meshletTriangles[i] ];
+	float length = glm::length(normalSum);
+	meshlet.coneAxis = length > 0.0f ? normalSum / length : glm::vec3(0.0f, 0.0f, 1.0f);
+
+	// The normal furthest from the axis gives the half angle
+	float minDot = length > 0.0f ? 1.0f : -1.0f;
+	for ( size_t i=0; i<meshletTriangles.size(); i++ ){
+		const glm::vec3 & normal = triangleNormals[ meshletTriangles[i] ];
+		if ( normal != glm::vec3(0.0f) ) // Degenerate triangles face nowhere
+			minDot = std::min(minDot, glm::dot(normal, meshlet.coneAxis));
+	}
+	meshlet.coneCutoff = minDot <= 0.0f ? 1.0f : sqrtf(std::max(0.0f, 1.0f - minDot * minDot));
+	meshlets.push_back(meshlet);
+}
+
+// Same position, same id. Faceted meshes don't share vertices between
+// triangles : their neighbourhood is only visible through the positions.
+static void buildPositionIds(const std::vector<glm::vec3> & vertices, std::vector<unsigned int> & positionId){
+	std::vector<unsigned int> order(vertices.size());
+	for ( size_t v=0; v<order.size(); v++ )
+		order[v] = (unsigned int)v;
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b){
+		const glm::vec3 & p = vertices[a];
+		const glm::vec3 & q = vertices[b];
+		if ( p.x != q.x ) return p.x < q.x;
+		if ( p.y != q.y ) return p.y < q.y;
+		return p.z < q.z;
+	});
+	positionId.resize(vertices.size());
+	for ( size_t i=0; i<order.size(); i++ )
+		positionId[ order[i] ] = i > 0 && vertices[order[i]] == vertices[order[i-1]] ? positionId[ order[i-1] ] : order[i];
+}
+
+// Backface culling only hides what the depth test would hide anyway on a
+// closed mesh. On an open one, the back of the surface is visible.
+template <typename IndexType>
+static bool isClosedMesh(const std::vector<IndexType> & indices, const std::vector<unsigned int> & positionId){
+	// Every edge must have exactly two triangles
+	std::vector<uint64_t> edges;
+	edges.reserve(indices.size());
+	for ( size_t t=0; t+2<indices.size(); t+=3 )
+		for ( int k=0; k<3; k++ ){
+			uint64_t a = positionId[ indices[t+k] ];
+			uint64_t b = positionId[ indices[t+(k+1)%3] ];
+			edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+		}
+	std::sort(edges.begin(), edges.end());
+	for ( size_t i=0; i<edges.size(); i+=2 )
+		if ( i+1 >= edges.size() || edges[i] != edges[i+1] || (i+2 < edges.size() && edges[i+2] == edges[i]) )
+			return false;
+	return true;
+}
+
+template <typename IndexType>
+void buildMeshlets(
+	std::vector<IndexType> & indices,
+	const std::vector<glm::vec3> & vertices,
+	std::vector<Meshlet> & out_meshlets
+){
+	const unsigned int kNone = ~0u;
+	const unsigned char kNotInMeshlet = 0xff;
+	size_t triangleCount = indices.size() / 3;
+	size_t vertexCount = vertices.size();
+	out_meshlets.clear();
+	if ( triangleCount == 0 )
+		return;
+
+	std::vector<glm::vec3> triangleNormals(triangleCount);
+	for ( size_t t=0; t<triangleCount; t++ ){
+		const glm::vec3 & p0 = vertices[ indices[t*3] ];
+		glm::vec3 normal = glm::cross(vertices[ indices[t*3+1] ] - p0, vertices[ indices[t*3+2] ] - p0);
+		float length = glm::length(normal);
+		triangleNormals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+	}
+
+	std::vector<unsigned int> positionId;
+	buildPositionIds(vertices, positionId);
+
+	// Triangles around each position. The first remaining[p] entries of a
+	// position's range are the triangles not in a meshlet yet.
+	std::vector<unsigned int> remaining(vertexCount, 0);
+	for ( size_t i=0; i<triangleCount*3; i++ )
+		remaining[ positionId[ indices[i] ] ]++;
+	std::vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+	for ( size_t v=0; v<vertexCount; v++ )
+		firstTriangle[v+1] = firstTriangle[v] + remaining[v];
+	std::vector<unsigned int> vertexTriangles(triangleCount * 3);
+	std::vector<unsigned int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+	for ( size_t t=0; t<triangleCount; t++ )
+		for ( int k=0; k<3; k++ )
+			vertexTriangles[ filled[ positionId[ indices[t*3+k] ] ]++ ] = (unsigned int)t;
+
+	std::vector<char> emitted(triangleCount, 0);
+	std::vector<unsigned char> localIndex(vertexCount, kNotInMeshlet);
+	std::vector<unsigned int> meshletVertices;
+	std::vector<unsigned int> meshletTriangles;
+	meshletVertices.reserve(kMeshletMaxVertices);
+	meshletTriangles.reserve(kMeshletMaxTriangles);
+	glm::vec3 normalSum(0.0f);
+	std::vector<IndexType> result;
+	result.reserve(indices.size());
+	size_t nextSeed = 0;
+
+	for ( size_t n=0; n<triangleCount; n++ ){
+		// Grow the meshlet with the neighbour that adds the fewest vertices
+		// and faces the most like the rest of it
+		unsigned int best = kNone;
+		if ( meshletTriangles.size() < kMeshletMaxTriangles ){
+			float length = glm::length(normalSum);
+			glm::vec3 axis = length > 0.0f ? normalSum / length : glm::vec3(0.0f);
+			float bestScore = FLT_MAX;
+			for ( size_t i=0; i<meshletVertices.size(); i++ ){
+				unsigned int p = positionId[ meshletVertices[i] ];
+				const unsigned int * list = &vertexTriangles[ firstTriangle[p] ];
+				unsigned int neighbours = std::min(remaining[p], kMeshletMaxNeighbours);
+				for ( unsigned int j=0; j<neighbours; j++ ){
+					unsigned int t = list[j];
+					if ( emitted[t] )
+						continue; // Degenerate triangle listed twice
+					IndexType a = indices[t*3], b = indices[t*3+1], c = indices[t*3+2];
+					unsigned int added =
+						(localIndex[a] == kNotInMeshlet) +
+						(localIndex[b] == kNotInMeshlet && b != a) +
+						(localIndex[c] == kNotInMeshlet && c != a && c != b);
+					if ( meshletVertices.size() + added > kMeshletMaxVertices )
+						continue;
+					float score = added + kMeshletConeWeight * (1.0f - glm::dot(triangleNormals[t], axis));
+					if ( score < bestScore ){
+						bestScore = score;
+						best = t;
+					}
+				}
+			}
+		}
+
+		if ( best == kNone ){
+			// Full, or nothing around : close this meshlet and start the next
+			// one from the first triangle left, in the original order
+			if ( !meshletTriangles.empty() ){
+				appendMeshlet(out_meshlets, result.size(), meshletVertices, meshletTriangles, vertices, triangleNormals);
+				for ( size_t i=0; i<meshletVertices.size(); i++ )
+					localIndex[ meshletVertices[i] ] = kNotInMeshlet;
+				meshletVertices.clear();
+				meshletTriangles.clear();
+				normalSum = glm::vec3(0.0f);
+			}
+			while ( emitted[nextSeed] )
+				nextSeed++;
+			best = (unsigned int)nextSeed;
+		}
+
+		unsigned int t = best;
+		emitted[t] = 1;
+		meshletTriangles.push_back(t);
+		normalSum += triangleNormals[t];
+		for ( int k=0; k<3; k++ ){
+			IndexType v = indices[t*3+k];
+			result.push_back(v);
+			if ( localIndex[v] == kNotInMeshlet ){
+				localIndex[v] = (unsigned char)meshletVertices.size();
+				meshletVertices.push_back(v);
+			}
+			// The triangle is taken
+			unsigned int p = positionId[v];
+			unsigned int * list = &vertexTriangles[ firstTriangle[p] ];
+			for ( unsigned int j=0; j<remaining[p]; j++ ){
+				if ( list[j] == t ){
+					list[j] = list[ remaining[p] - 1 ];
+					list[ remaining[p] - 1 ] = t;
+					remaining[p]--;
+					break;
+				}
+			}
+		}
+	}
+
+	appendMeshlet(out_meshlets, result.size(), meshletVertices, meshletTriangles, vertices, triangleNormals);
+	indices.swap(result);
+
+	if ( !isClosedMesh(indices, positionId) )
+		for ( size_t i=0; i<out_meshlets.size(); i++ )
+			out_meshlets[i].coneCutoff = 1.0f;
+}
+
+float meshletCulledFraction(const Meshlet * meshlets, size_t meshletCount, const glm::vec3 & camera){
+	size_t total = 0, culled = 0;
+	for ( size_t i=0; i<meshletCount; i++ ){
+		total += meshlets[i].triangleCount;
+		if ( isMeshletBackfacing(meshlets[i], camera) )
+			culled += meshlets[i].triangleCount;
+	}
+	return total == 0 ? 0.0f : (float)culled / total;
+}
+
+// Average over a camera path
+static float averageCulledFraction(const Meshlet * meshlets, size_t meshletCount, const std::vector<glm::vec3> & path){
+	double sum = 0.0;
+	for ( size_t i=0; i<path.size(); i++ )
+		sum += meshletCulledFraction(meshlets, meshletCount, path[i]);
+	return path.empty() ? 0.0f : (float)(sum / path.size());
+}
+
+void printMeshletReport(const Meshlet * meshlets, size_t meshletCount){
+	if ( meshletCount == 0 )
+		return;
+
+	size_t triangles = 0, vertices = 0, cullable = 0;
+	glm::vec3 lower = meshlets[0].center - glm::vec3(meshlets[0].radius);
+	glm::vec3 upper = meshlets[0].center + glm::vec3(meshlets[0].radius);
+	for ( size_t i=0; i<meshletCount; i++ ){
+		triangles += meshlets[i].triangleCount;
+		vertices += meshlets[i].vertexCount;
+		cullable += meshlets[i].coneCutoff < 1.0f;
+		lower = glm::min(lower, meshlets[i].center - glm::vec3(meshlets[i].radius));
+		upper = glm::max(upper, meshlets[i].center + glm::vec3(meshlets[i].radius));
+	}
+	glm::vec3 center = (lower + upper) * 0.5f;
+	float radius = glm::length(upper - lower) * 0.5f;
+
+	// hw1 : the camera circles around the X then the Y axis, 5 units away
+	// from a unit sized figure, one degree per frame
+	const float kPi = 3.14159265f;
+	std::vector<glm::vec3> orbitX, orbitY;
+	for ( int step=0; step<720; step++ ){
+		float angle = step * kPi / 360;
+		orbitX.push_back(center + 5.0f * radius * glm::vec3(0.0f, cosf(angle), sinf(angle)));
+		orbitY.push_back(center + 5.0f * radius * glm::vec3(cosf(angle), 0.0f, sinf(angle)));
+	}
+	// common/controls.cpp : 3 units per second at 60 frames per second,
+	// here holding "up" toward the mesh then "right" past it
+	std::vector<glm::vec3> free;
+	const float kStep = 3.0f / 60.0f * radius;
+	glm::vec3 position = center + glm::vec3(0.0f, 0.0f, 10.0f * radius);
+	while ( position.z > center.z + 2.0f * radius ){
+		free.push_back(position);
+		position.z -= kStep;
+	}
+	while ( position.x < center.x + 10.0f * radius ){
+		free.push_back(position);
+		position.x += kStep;
+	}
+
+	printf("Meshlets : %u, %.1f vertices and %.1f triangles each, %u with a usable cone\n",
+		(unsigned int)meshletCount, (float)vertices / meshletCount, (float)triangles / meshletCount, (unsigned int)cullable);
+	printf("Triangles culled : orbit around X %.1f%%, orbit around Y %.1f%%, free camera %.1f%%\n",
+		100.0f * averageCulledFraction(meshlets, meshletCount, orbitX),
+		100.0f * averageCulledFraction(meshlets, meshletCount, orbitY),
+		100.0f * averageCulledFraction(meshlets, meshletCount, free));
+}
+
+template void buildMeshlets<unsigned short>(std::vector<unsigned short> &, const std::vector<glm::vec3> &, std::vector<Meshlet> &);
+template void buildMeshlets<unsigned int>(std::vector<unsigned int> &, const std::vector<glm::vec3> &, std::vector<Meshlet> &);
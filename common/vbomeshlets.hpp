@@ -0,0 +1,52 @@
+#ifndef VBOMESHLETS_HPP
+#define VBOMESHLETS_HPP
+
+// Splits an indexed triangle list into small clusters (meshlets) that can be
+// culled on their own. There are no mesh shaders in GL 3.3, so a meshlet is
+// a contiguous range of the index buffer : the visible ones are drawn with
+// glMultiDrawElements.
+
+static const unsigned int kMeshletMaxVertices = 64;
+static const unsigned int kMeshletMaxTriangles = 124;
+
+struct Meshlet {
+	// Bounding sphere
+	glm::vec3 center;
+	float radius;
+	// Cone around the normals of the triangles. coneCutoff is the sine of its
+	// half angle; 1 when the normals are too spread out to ever cull.
+	glm::vec3 coneAxis;
+	float coneCutoff;
+	unsigned int indexOffset;   // in indices
+	unsigned int triangleCount;
+	unsigned int vertexCount;   // distinct vertices, at most kMeshletMaxVertices
+	unsigned int reserved;
+};
+
+// Groups neighbouring triangles that face the same way into meshlets of at
+// most kMeshletMaxVertices vertices and kMeshletMaxTriangles triangles, and
+// reorders the triangles so that each meshlet is a range of indices.
+// IndexType is unsigned short or unsigned int.
+template <typename IndexType>
+void buildMeshlets(
+	std::vector<IndexType> & indices,
+	const std::vector<glm::vec3> & vertices,
+	std::vector<Meshlet> & out_meshlets
+);
+
+// True if every triangle of the meshlet faces away from a camera at this
+// position (in the same space as the mesh). Conservative.
+inline bool isMeshletBackfacing(const Meshlet & meshlet, const glm::vec3 & camera){
+	glm::vec3 view = meshlet.center - camera;
+	return glm::dot(view, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(view) + meshlet.radius;
+}
+
+// Fraction of the triangles a camera at this position doesn't draw
+float meshletCulledFraction(const Meshlet * meshlets, size_t meshletCount, const glm::vec3 & camera);
+
+// Prints the meshlet statistics and how much backface culling saves along
+// the orbits of hw1 (around the X and Y axes, 5 times the mesh radius away)
+// and a free camera walking past the mesh like common/controls.cpp moves it
+void printMeshletReport(const Meshlet * meshlets, size_t meshletCount);
+
+#endif
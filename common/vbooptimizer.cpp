@@ -0,0 +1,222 @@
+#include <vector>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "vbooptimizer.hpp"
+
+template <typename IndexType>
+VertexCacheStats analyzeVertexCache(
+	const std::vector<IndexType> & indices,
+	size_t vertexCount,
+	unsigned int cacheSize
+){
+	// A vertex is in the cache if fewer than cacheSize misses happened since
+	// its own miss : no need to actually move entries around.
+	std::vector<unsigned int> missTime(vertexCount, 0);
+	unsigned int time = cacheSize + 1;
+	size_t misses = 0;
+	for ( size_t i=0; i<indices.size(); i++ ){
+		IndexType v = indices[i];
+		if ( time - missTime[v] > cacheSize ){
+			missTime[v] = time++;
+			misses++;
+		}
+	}
+
+	VertexCacheStats stats;
+	stats.acmr = indices.empty() ? 0.0f : (float)misses / (indices.size() / 3);
+	stats.atvr = vertexCount == 0 ? 0.0f : (float)misses / vertexCount;
+	return stats;
+}
+
+// Tuning from Forsyth's article
+static const int kForsythCacheSize = 32;
+static const float kForsythCacheDecayPower = 1.5f;
+static const float kForsythLastTriangleScore = 0.75f;
+static const float kForsythValenceBoostScale = 2.0f;
+static const float kForsythValenceBoostPower = 0.5f;
+
+// How much we want to use a vertex next, from its position in the LRU cache
+// (-1 if not in it) and the number of triangles still using it
+static float forsythVertexScore(int cachePosition, unsigned int remainingTriangles){
+	if ( remainingTriangles == 0 )
+		return -1.0f; // Nothing left to draw with it
+
+	float score = 0.0f;
+	if ( cachePosition >= 0 ){
+		if ( cachePosition < 3 ){
+			// Used by the last triangle. Fixed score, whichever of the three
+			// it is, so the next triangle doesn't favour a particular edge.
+			score = kForsythLastTriangleScore;
+		}else{
+			float scaler = 1.0f / (kForsythCacheSize - 3);
+			score = powf(1.0f - (cachePosition - 3) * scaler, kForsythCacheDecayPower);
+		}
+	}
+	// Boost vertices with few triangles left, to finish them off and avoid
+	// leaving lonely triangles behind
+	score += kForsythValenceBoostScale * powf((float)remainingTriangles, -kForsythValenceBoostPower);
+	return score;
+}
+
+template <typename IndexType>
+void optimizeVertexCache(
+	std::vector<IndexType> & indices,
+	size_t vertexCount
+){
+	const unsigned int kNone = ~0u;
+	size_t triangleCount = indices.size() / 3;
+	if ( triangleCount == 0 )
+		return;
+
+	// Triangles of each vertex. The first remaining[v] entries of a vertex's
+	// range are the triangles not emitted yet.
+	std::vector<unsigned int> remaining(vertexCount, 0);
+	for ( size_t i=0; i<triangleCount*3; i++ )
+		remaining[ indices[i] ]++;
+	std::vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+	for ( size_t v=0; v<vertexCount; v++ )
+		firstTriangle[v+1] = firstTriangle[v] + remaining[v];
+	std::vector<unsigned int> vertexTriangles(triangleCount * 3);
+	std::vector<unsigned int> filled(vertexCount, 0);
+	for ( size_t t=0; t<triangleCount; t++ )
+		for ( int k=0; k<3; k++ ){
+			IndexType v = indices[t*3+k];
+			vertexTriangles[ firstTriangle[v] + filled[v]++ ] = (unsigned int)t;
+		}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for ( size_t v=0; v<vertexCount; v++ )
+		vertexScore[v] = forsythVertexScore(-1, remaining[v]);
+
+	std::vector<char> emitted(triangleCount, 0);
+	std::vector<IndexType> result;
+	result.reserve(triangleCount * 3);
+
+	// Start with the best triangle of the whole mesh
+	unsigned int best = 0;
+	float bestScore = -1.0f;
+	for ( size_t t=0; t<triangleCount; t++ ){
+		float score = vertexScore[indices[t*3]] + vertexScore[indices[t*3+1]] + vertexScore[indices[t*3+2]];
+		if ( score > bestScore ){
+			bestScore = score;
+			best = (unsigned int)t;
+		}
+	}
+
+	std::vector<unsigned int> cache, nextCache;
+	cache.reserve(kForsythCacheSize + 3);
+	nextCache.reserve(kForsythCacheSize + 3);
+	size_t nextUnemitted = 0;
+
+	for ( size_t n=0; n<triangleCount; n++ ){
+		if ( best == kNone ){
+			// Nothing in the cache leads anywhere, jump to the next triangle
+			// that is left. The scan only ever moves forward.
+			while ( emitted[nextUnemitted] )
+				nextUnemitted++;
+			best = (unsigned int)nextUnemitted;
+		}
+
+		unsigned int t = best;
+		emitted[t] = 1;
+		IndexType corners[3] = { indices[t*3], indices[t*3+1], indices[t*3+2] };
+		result.push_back(corners[0]);
+		result.push_back(corners[1]);
+		result.push_back(corners[2]);
+
+		// This triangle doesn't need its vertices anymore
+		for ( int k=0; k<3; k++ ){
+			IndexType v = corners[k];
+			unsigned int * list = &vertexTriangles[ firstTriangle[v] ];
+			for ( unsigned int j=0; j<remaining[v]; j++ ){
+				if ( list[j] == t ){
+					list[j] = list[ remaining[v] - 1 ];
+					list[ remaining[v] - 1 ] = t;
+					remaining[v]--;
+					break;
+				}
+			}
+		}
+
+		// LRU update : the triangle's vertices go in front
+		nextCache.clear();
+		for ( int k=0; k<3; k++ )
+			if ( k == 0 || (corners[k] != corners[0] && (k == 1 || corners[k] != corners[1])) )
+				nextCache.push_back(corners[k]);
+		for ( size_t j=0; j<cache.size(); j++ )
+			if ( cache[j] != corners[0] && cache[j] != corners[1] && cache[j] != corners[2] )
+				nextCache.push_back(cache[j]);
+		for ( size_t j=kForsythCacheSize; j<nextCache.size(); j++ ){ // Evicted
+			cachePosition[ nextCache[j] ] = -1;
+			vertexScore[ nextCache[j] ] = forsythVertexScore(-1, remaining[ nextCache[j] ]);
+		}
+		if ( nextCache.size() > (size_t)kForsythCacheSize )
+			nextCache.resize(kForsythCacheSize);
+		cache.swap(nextCache);
+
+		for ( size_t j=0; j<cache.size(); j++ ){
+			cachePosition[ cache[j] ] = (int)j;
+			vertexScore[ cache[j] ] = forsythVertexScore((int)j, remaining[ cache[j] ]);
+		}
+
+		// The next triangle is the best one using a cached vertex
+		best = kNone;
+		bestScore = -1.0f;
+		for ( size_t j=0; j<cache.size(); j++ ){
+			IndexType v = cache[j];
+			const unsigned int * list = &vertexTriangles[ firstTriangle[v] ];
+			for ( unsigned int k=0; k<remaining[v]; k++ ){
+				unsigned int c = list[k];
+				float score = vertexScore[indices[c*3]] + vertexScore[indices[c*3+1]] + vertexScore[indices[c*3+2]];
+				if ( score > bestScore ){
+					bestScore = score;
+					best = c;
+				}
+			}
+		}
+	}
+
+	indices.swap(result);
+}
+
+template <typename IndexType>
+void optimizeVertexFetch(
+	std::vector<IndexType> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+){
+	const unsigned int kNone = ~0u;
+	std::vector<unsigned int> remap(vertices.size(), kNone);
+	unsigned int used = 0;
+	for ( size_t i=0; i<indices.size(); i++ ){
+		IndexType & index = indices[i];
+		if ( remap[index] == kNone )
+			remap[index] = used++;
+		index = (IndexType)remap[index];
+	}
+
+	std::vector<glm::vec3> newVertices(used);
+	std::vector<glm::vec2> newUVs(used);
+	std::vector<glm::vec3> newNormals(used);
+	for ( size_t v=0; v<vertices.size(); v++ ){
+		if ( remap[v] == kNone )
+			continue;
+		newVertices[ remap[v] ] = vertices[v];
+		newUVs     [ remap[v] ] = uvs[v];
+		newNormals [ remap[v] ] = normals[v];
+	}
+	vertices.swap(newVertices);
+	uvs     .swap(newUVs);
+	normals .swap(newNormals);
+}
+
+template VertexCacheStats analyzeVertexCache<unsigned short>(const std::vector<unsigned short> &, size_t, unsigned int);
+template VertexCacheStats analyzeVertexCache<unsigned int>(const std::vector<unsigned int> &, size_t, unsigned int);
+template void optimizeVertexCache<unsigned short>(std::vector<unsigned short> &, size_t);
+template void optimizeVertexCache<unsigned int>(std::vector<unsigned int> &, size_t);
+template void optimizeVertexFetch<unsigned short>(std::vector<unsigned short> &, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+template void optimizeVertexFetch<unsigned int>(std::vector<unsigned int> &, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &);
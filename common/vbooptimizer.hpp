@@ -0,0 +1,42 @@
+#ifndef VBOOPTIMIZER_HPP
+#define VBOOPTIMIZER_HPP
+
+// Mesh optimization passes for indexed triangle lists, to run after
+// indexVBO (or loadOBJ_indexed). IndexType is unsigned short or unsigned int.
+
+// How a post-transform vertex cache behaves on an index buffer.
+// ACMR : vertices transformed per triangle (0.5 at best, 3 at worst).
+// ATVR : vertices transformed per distinct vertex (1 at best).
+struct VertexCacheStats {
+	float acmr;
+	float atvr;
+};
+
+// Simulates a FIFO cache of cacheSize entries, like most GPUs have
+template <typename IndexType>
+VertexCacheStats analyzeVertexCache(
+	const std::vector<IndexType> & indices,
+	size_t vertexCount,
+	unsigned int cacheSize = 16
+);
+
+// Reorders the triangles so that consecutive triangles share vertices
+// (Tom Forsyth's "Linear-Speed Vertex Cache Optimisation").
+// Vertices are not touched.
+template <typename IndexType>
+void optimizeVertexCache(
+	std::vector<IndexType> & indices,
+	size_t vertexCount
+);
+
+// Reorders the vertices in the order the index buffer first uses them, so
+// vertex fetch walks memory forward. Unreferenced vertices are dropped.
+template <typename IndexType>
+void optimizeVertexFetch(
+	std::vector<IndexType> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+);
+
+#endif
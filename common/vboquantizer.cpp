@@ -0,0 +1,180 @@
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "vboquantizer.hpp"
+
+// Round to nearest even, like the GPU does
+unsigned short floatToHalf(float value){
+	unsigned int f;
+	memcpy(&f, &value, sizeof(f));
+	unsigned int sign = (f >> 16) & 0x8000;
+	unsigned int exponent = (f >> 23) & 0xff;
+	unsigned int mantissa = f & 0x7fffff;
+
+	if ( exponent == 0xff ) // Inf or NaN
+		return (unsigned short)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+	int e = (int)exponent - 127 + 15;
+	if ( e >= 0x1f ) // Too large, becomes Inf
+		return (unsigned short)(sign | 0x7c00);
+
+	if ( e <= 0 ){ // Half subnormal (or zero)
+		if ( e < -10 )
+			return (unsigned short)sign;
+		mantissa |= 0x800000;
+		unsigned int shift = 14 - e;
+		unsigned int half = mantissa >> shift;
+		unsigned int rest = mantissa & ((1u << shift) - 1);
+		unsigned int midpoint = 1u << (shift - 1);
+		if ( rest > midpoint || (rest == midpoint && (half & 1)) )
+			half++;
+		return (unsigned short)(sign | half);
+	}
+
+	unsigned int half = ((unsigned int)e << 10) | (mantissa >> 13);
+	unsigned int rest = mantissa & 0x1fff;
+	if ( rest > 0x1000 || (rest == 0x1000 && (half & 1)) )
+		half++; // A carry into the exponent is the right result
+	return (unsigned short)(sign | half);
+}
+
+float halfToFloat(unsigned short value){
+	unsigned int sign = (unsigned int)(value & 0x8000) << 16;
+	unsigned int exponent = (value >> 10) & 0x1f;
+	unsigned int mantissa = value & 0x3ff;
+
+	unsigned int f;
+	if ( exponent == 0x1f ){
+		f = sign | 0x7f800000 | (mantissa << 13);
+	}else if ( exponent == 0 ){
+		float subnormal = mantissa * (1.0f / 16777216.0f); // mantissa * 2^-24
+		return sign ? -subnormal : subnormal;
+	}else{
+		f = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+	float result;
+	memcpy(&result, &f, sizeof(result));
+	return result;
+}
+
+static inline float signNotZero(float v){
+	return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+// Same code as oct_decode in the vertex shader
+glm::vec3 octDecode(const signed char encoded[2]){
+	glm::vec3 n(
+		glm::max(encoded[0] / 127.0f, -1.0f),
+		glm::max(encoded[1] / 127.0f, -1.0f),
+		0.0f
+	);
+	n.z = 1.0f - fabsf(n.x) - fabsf(n.y);
+	if ( n.z < 0.0f ){
+		float x = n.x;
+		n.x = (1.0f - fabsf(n.y)) * signNotZero(x);
+		n.y = (1.0f - fabsf(x)) * signNotZero(n.y);
+	}
+	return glm::normalize(n);
+}
+
+void octEncode(glm::vec3 normal, signed char out[2]){
+	float l1 = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	// No direction to keep : a zero normal, or one with a NaN or an
+	// infinite component, which no candidate below would match
+	if ( l1 == 0.0f || !isfinite(l1) ){
+		out[0] = out[1] = 0;
+		return;
+	}
+	// Project on the octahedron, and fold the lower half over the upper one
+	glm::vec2 p(normal.x / l1, normal.y / l1);
+	if ( normal.z < 0.0f )
+		p = glm::vec2((1.0f - fabsf(p.y)) * signNotZero(p.x), (1.0f - fabsf(p.x)) * signNotZero(p.y));
+
+	// Rounding each coordinate to the nearest isn't always the closest
+	// direction : try the 4 neighbours on the 8-bit grid
+	glm::vec3 reference = glm::normalize(normal);
+	float best = -2.0f;
+	for ( int i=0; i<4; i++ ){
+		float x = (i & 1) ? ceilf(p.x * 127.0f) : floorf(p.x * 127.0f);
+		float y = (i & 2) ? ceilf(p.y * 127.0f) : floorf(p.y * 127.0f);
+		signed char candidate[2] = {
+			(signed char)glm::clamp(x, -127.0f, 127.0f),
+			(signed char)glm::clamp(y, -127.0f, 127.0f),
+		};
+		float similarity = glm::dot(octDecode(candidate), reference);
+		if ( similarity > best ){
+			best = similarity;
+			out[0] = candidate[0];
+			out[1] = candidate[1];
+		}
+	}
+}
+
+void quantizeVertices(
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	std::vector<QuantizedVertex> & out_vertices,
+	QuantizationParams & out_params
+){
+	glm::vec3 lower(0.0f), upper(0.0f);
+	if ( !vertices.empty() ){
+		lower = upper = vertices[0];
+		for ( size_t i=1; i<vertices.size(); i++ ){
+			lower = glm::min(lower, vertices[i]);
+			upper = glm::max(upper, vertices[i]);
+		}
+	}
+	out_params.offset = lower;
+	out_params.scale = upper - lower;
+
+	out_vertices.resize(vertices.size());
+	for ( size_t i=0; i<vertices.size(); i++ ){
+		QuantizedVertex & q = out_vertices[i];
+		for ( int k=0; k<3; k++ ){
+			float extent = out_params.scale[k];
+			float t = extent > 0.0f ? (vertices[i][k] - lower[k]) / extent : 0.0f;
+			q.position[k] = (unsigned short)(glm::clamp(t, 0.0f, 1.0f) * 65535.0f + 0.5f);
+		}
+		octEncode(normals[i], q.normal);
+		q.uv[0] = floatToHalf(uvs[i].x);
+		q.uv[1] = floatToHalf(uvs[i].y);
+	}
+}
+
+QuantizationError measureQuantizationError(
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	const std::vector<QuantizedVertex> & quantized,
+	const QuantizationParams & params
+){
+	QuantizationError error = { 0.0f, 0.0f, 0.0f };
+	float minCosine = 1.0f;
+	for ( size_t i=0; i<quantized.size(); i++ ){
+		const QuantizedVertex & q = quantized[i];
+		glm::vec3 position(
+			params.offset.x + q.position[0] / 65535.0f * params.scale.x,
+			params.offset.y + q.position[1] / 65535.0f * params.scale.y,
+			params.offset.z + q.position[2] / 65535.0f * params.scale.z
+		);
+		glm::vec2 uv(halfToFloat(q.uv[0]), halfToFloat(q.uv[1]));
+
+		error.maxPosition = glm::max(error.maxPosition, glm::length(position - vertices[i]));
+		error.maxUV = glm::max(error.maxUV, glm::length(uv - uvs[i]));
+		if ( glm::length(normals[i]) > 0.0f )
+			minCosine = glm::min(minCosine, glm::dot(octDecode(q.normal), glm::normalize(normals[i])));
+	}
+	error.maxNormalDegrees = acosf(glm::clamp(minCosine, -1.0f, 1.0f)) * 180.0f / 3.14159265f;
+	return error;
+}
+
+void printQuantizationError(const char * name, const QuantizationError & error, size_t vertexCount){
+	printf("Quantized %s : %u vertices, %u -> %u bytes per vertex\n", name, (unsigned int)vertexCount,
+		(unsigned int)(sizeof(glm::vec3) + sizeof(glm::vec2) + sizeof(glm::vec3)), (unsigned int)sizeof(QuantizedVertex));
+	printf("  max error : position %g, uv %g, normal %.3f degrees\n", error.maxPosition, error.maxUV, error.maxNormalDegrees);
+}
@@ -0,0 +1,54 @@
+#ifndef VBOQUANTIZER_HPP
+#define VBOQUANTIZER_HPP
+
+// Compressed vertex format, 12 bytes instead of 32 for the float
+// position + uv + normal (20 without the normal) :
+// - position : 16-bit unsigned normalized, inside the mesh bounding box
+// - normal   : octahedral encoding, 2 x 8 bits, decoded in the vertex shader
+// - uv       : 2 half floats
+// Each attribute starts on its natural alignment.
+struct QuantizedVertex {
+	unsigned short position[3];
+	signed char normal[2];
+	unsigned short uv[2];
+};
+
+// position = offset + unorm16 * scale, unorm16 being in [0, 1]
+struct QuantizationParams {
+	glm::vec3 offset;
+	glm::vec3 scale;
+};
+
+struct QuantizationError {
+	float maxPosition;      // in model units
+	float maxUV;
+	float maxNormalDegrees;
+};
+
+void quantizeVertices(
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	std::vector<QuantizedVertex> & out_vertices,
+	QuantizationParams & out_params
+);
+
+// Decodes everything back and compares with the original attributes
+QuantizationError measureQuantizationError(
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	const std::vector<QuantizedVertex> & quantized,
+	const QuantizationParams & params
+);
+
+// Prints the error report of a quantized mesh
+void printQuantizationError(const char * name, const QuantizationError & error, size_t vertexCount);
+
+unsigned short floatToHalf(float value);
+float halfToFloat(unsigned short value);
+
+void octEncode(glm::vec3 normal, signed char out[2]);
+glm::vec3 octDecode(const signed char encoded[2]);
+
+#endif
@@ -0,0 +1,343 @@
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "vbosimplifier.hpp"
+
+// Sum of squared distances to a set of planes, weighted by triangle area :
+// error(p) = p.A.p + 2 b.p + c, with A symmetric
+struct Quadric {
+	double a00, a11, a22, a01, a02, a12;
+	double b0, b1, b2;
+	double c;
+	double weight;
+};
+
+static void addPlaneQuadric(Quadric & q, const glm::vec3 & p0, const glm::vec3 & p1, const glm::vec3 & p2){
+	glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+	float length = glm::length(normal);
+	if ( length == 0.0f )
+		return;
+	normal /= length;
+	double weight = length * 0.5; // Triangle area
+	double nx = normal.x, ny = normal.y, nz = normal.z;
+	double d = -(nx * p0.x + ny * p0.y + nz * p0.z);
+
+	q.a00 += weight * nx * nx;
+	q.a11 += weight * ny * ny;
+	q.a22 += weight * nz * nz;
+	q.a01 += weight * nx * ny;
+	q.a02 += weight * nx * nz;
+	q.a12 += weight * ny * nz;
+	q.b0 += weight * nx * d;
+	q.b1 += weight * ny * d;
+	q.b2 += weight * nz * d;
+	q.c += weight * d * d;
+	q.weight += weight;
+}
+
+static void addQuadric(Quadric & q, const Quadric & other){
+	q.a00 += other.a00; q.a11 += other.a11; q.a22 += other.a22;
+	q.a01 += other.a01; q.a02 += other.a02; q.a12 += other.a12;
+	q.b0 += other.b0; q.b1 += other.b1; q.b2 += other.b2;
+	q.c += other.c;
+	q.weight += other.weight;
+}
+
+// Weighted sum of the squared distances from p to the planes of the quadric
+static double quadricDistance(const Quadric & q, const glm::vec3 & p){
+	double x = p.x, y = p.y, z = p.z;
+	return
+		q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+		2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+		2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) +
+		q.c;
+}
+
+// Mean squared distance from p to the planes of both quadrics, without
+// building their sum
+static double collapseError(const Quadric & q0, const Quadric & q1, const glm::vec3 & p){
+	double weight = q0.weight + q1.weight;
+	double error = quadricDistance(q0, p) + quadricDistance(q1, p);
+	return weight > 0.0 ? fabs(error) / weight : 0.0;
+}
+
+static bool lessPosition(const glm::vec3 & a, const glm::vec3 & b){
+	if ( a.x != b.x ) return a.x < b.x;
+	if ( a.y != b.y ) return a.y < b.y;
+	return a.z < b.z;
+}
+
+// Vertices that only differ by their normal are the same vertex here : the
+// normals of the LODs come from whichever of them is picked
+static void weldNormalSeams(
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	std::vector<unsigned int> & weld
+){
+	size_t vertexCount = vertices.size();
+	std::vector<unsigned int> order(vertexCount);
+	for ( size_t v=0; v<vertexCount; v++ )
+		order[v] = (unsigned int)v;
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b){
+		if ( vertices[a] != vertices[b] )
+			return lessPosition(vertices[a], vertices[b]);
+		if ( uvs[a].x != uvs[b].x )
+			return uvs[a].x < uvs[b].x;
+		return uvs[a].y < uvs[b].y;
+	});
+	weld.resize(vertexCount);
+	for ( size_t i=0; i<vertexCount; i++ ){
+		unsigned int v = order[i];
+		unsigned int previous = i > 0 ? order[i-1] : v;
+		weld[v] = i > 0 && vertices[v] == vertices[previous] && uvs[v] == uvs[previous] ? weld[previous] : v;
+	}
+}
+
+// A vertex is locked when its position is shared by another vertex (an
+// attribute seam) or sits on an edge that has a single triangle
+template <typename IndexType>
+static void findLockedVertices(
+	const std::vector<IndexType> & indices,
+	const std::vector<glm::vec3> & vertices,
+	std::vector<char> & locked
+){
+	size_t vertexCount = vertices.size();
+
+	// Same position, same id. Only the vertices the triangles use count.
+	std::vector<char> used(vertexCount, 0);
+	for ( size_t i=0; i<indices.size(); i++ )
+		used[ indices[i] ] = 1;
+	std::vector<unsigned int> order;
+	for ( size_t v=0; v<vertexCount; v++ )
+		if ( used[v] )
+			order.push_back((unsigned int)v);
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b){
+		return lessPosition(vertices[a], vertices[b]);
+	});
+	std::vector<unsigned int> positionId(vertexCount, 0);
+	locked.assign(vertexCount, 0);
+	for ( size_t i=0; i<order.size(); ){
+		size_t j = i + 1;
+		while ( j < order.size() && vertices[order[j]] == vertices[order[i]] )
+			j++;
+		for ( size_t k=i; k<j; k++ ){
+			positionId[order[k]] = order[i];
+			if ( j - i > 1 )
+				locked[order[k]] = 1;
+		}
+		i = j;
+	}
+
+	// An edge is on the border if it has a single triangle. Edges with more
+	// than 2 aren't manifold, and are locked as well.
+	std::vector<uint64_t> edges;
+	edges.reserve(indices.size());
+	for ( size_t t=0; t+2<indices.size(); t+=3 )
+		for ( int k=0; k<3; k++ ){
+			uint64_t a = positionId[ indices[t+k] ];
+			uint64_t b = positionId[ indices[t+(k+1)%3] ];
+			edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+		}
+	std::sort(edges.begin(), edges.end());
+	for ( size_t i=0; i<edges.size(); ){
+		size_t j = i + 1;
+		while ( j < edges.size() && edges[j] == edges[i] )
+			j++;
+		if ( j - i != 2 ){
+			locked[ edges[i] >> 32 ] = 1;
+			locked[ edges[i] & 0xffffffffu ] = 1;
+		}
+		i = j;
+	}
+	// Spread the border flags to every vertex of the position
+	for ( size_t v=0; v<vertexCount; v++ )
+		if ( used[v] && locked[ positionId[v] ] )
+			locked[v] = 1;
+}
+
+struct Collapse {
+	unsigned int from;
+	unsigned int to;
+	double error;
+};
+
+template <typename IndexType>
+float simplifyMesh(
+	const std::vector<IndexType> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	size_t targetIndexCount,
+	std::vector<IndexType> & out_indices
+){
+	const unsigned int kNone = ~0u;
+	size_t vertexCount = vertices.size();
+	out_indices = indices;
+	if ( indices.size() <= targetIndexCount )
+		return 0.0f;
+
+	std::vector<unsigned int> weld;
+	weldNormalSeams(vertices, uvs, weld);
+	for ( size_t i=0; i<out_indices.size(); i++ )
+		out_indices[i] = (IndexType)weld[ out_indices[i] ];
+
+	std::vector<char> locked;
+	findLockedVertices(out_indices, vertices, locked);
+
+	std::vector<Quadric> quadrics(vertexCount, Quadric());
+	for ( size_t t=0; t+2<out_indices.size(); t+=3 ){
+		const glm::vec3 & p0 = vertices[ out_indices[t] ];
+		const glm::vec3 & p1 = vertices[ out_indices[t+1] ];
+		const glm::vec3 & p2 = vertices[ out_indices[t+2] ];
+		Quadric q = Quadric();
+		addPlaneQuadric(q, p0, p1, p2);
+		for ( int k=0; k<3; k++ )
+			addQuadric(quadrics[ out_indices[t+k] ], q);
+	}
+
+	std::vector<unsigned int> firstTriangle(vertexCount + 1);
+	std::vector<unsigned int> vertexTriangles;
+	std::vector<unsigned int> remap(vertexCount);
+	std::vector<char> touched(vertexCount);
+	std::vector<unsigned int> neighbourStamp(vertexCount, kNone);
+	// Only grows, across the passes too : a stamp left by an earlier
+	// collapse never matches a later one
+	unsigned int stamp = 0;
+	std::vector<Collapse> best(vertexCount);
+	std::vector<Collapse> collapses;
+	double maxError = 0.0;
+
+	while ( out_indices.size() > targetIndexCount ){
+		size_t triangleCount = out_indices.size() / 3;
+
+		// Triangles of each vertex
+		std::fill(firstTriangle.begin(), firstTriangle.end(), 0);
+		for ( size_t i=0; i<out_indices.size(); i++ )
+			firstTriangle[ out_indices[i] + 1 ]++;
+		for ( size_t v=0; v<vertexCount; v++ )
+			firstTriangle[v+1] += firstTriangle[v];
+		vertexTriangles.resize(out_indices.size());
+		std::vector<unsigned int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+		for ( size_t t=0; t<triangleCount; t++ )
+			for ( int k=0; k<3; k++ )
+				vertexTriangles[ filled[ out_indices[t*3+k] ]++ ] = (unsigned int)t;
+
+		// The cheapest collapse of each vertex, over the edges in both directions
+		for ( size_t v=0; v<vertexCount; v++ ){
+			best[v].to = kNone;
+			best[v].error = 0.0;
+		}
+		for ( size_t t=0; t<triangleCount; t++ )
+			for ( int k=0; k<6; k++ ){
+				unsigned int a = out_indices[t*3 + k%3];
+				unsigned int b = out_indices[t*3 + (k < 3 ? (k+1)%3 : (k+2)%3)];
+				if ( locked[a] )
+					continue;
+				double error = collapseError(quadrics[a], quadrics[b], vertices[b]);
+				if ( best[a].to == kNone || error < best[a].error ){
+					best[a].from = a;
+					best[a].to = b;
+					best[a].error = error;
+				}
+			}
+		collapses.clear();
+		for ( size_t v=0; v<vertexCount; v++ )
+			if ( best[v].to != kNone )
+				collapses.push_back(best[v]);
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse & x, const Collapse & y){
+			return x.error < y.error;
+		});
+
+		// Each collapse removes about 2 triangles. A vertex takes part in one
+		// collapse per pass; the neighbours that already moved are looked up
+		// through remap, so the checks below see the current geometry.
+		size_t collapseBudget = (out_indices.size() - targetIndexCount) / 6 + 1;
+		size_t collapsed = 0;
+		std::fill(touched.begin(), touched.end(), 0);
+		for ( size_t v=0; v<vertexCount; v++ )
+			remap[v] = (unsigned int)v;
+
+		for ( size_t i=0; i<collapses.size() && collapsed < collapseBudget; i++ ){
+			unsigned int a = collapses[i].from;
+			unsigned int b = collapses[i].to;
+			if ( touched[a] || touched[b] )
+				continue;
+			const unsigned int * trianglesA = &vertexTriangles[ firstTriangle[a] ];
+			unsigned int countA = firstTriangle[a+1] - firstTriangle[a];
+			const unsigned int * trianglesB = &vertexTriangles[ firstTriangle[b] ];
+			unsigned int countB = firstTriangle[b+1] - firstTriangle[b];
+
+			// Link condition : a and b may only share the 2 neighbours of the
+			// edge, or the collapse pinches the surface
+			stamp++;
+			for ( unsigned int j=0; j<countA; j++ )
+				for ( int k=0; k<3; k++ )
+					neighbourStamp[ remap[ out_indices[trianglesA[j]*3+k] ] ] = stamp;
+			unsigned int shared = 0;
+			for ( unsigned int j=0; j<countB; j++ )
+				for ( int k=0; k<3; k++ ){
+					unsigned int v = remap[ out_indices[trianglesB[j]*3+k] ];
+					if ( v != a && v != b && neighbourStamp[v] == stamp ){
+						neighbourStamp[v] = kNone; // Count each vertex once
+						shared++;
+					}
+				}
+			if ( shared > 2 )
+				continue;
+
+			// Moving a onto b must not flip the triangles that remain
+			bool valid = true;
+			for ( unsigned int j=0; j<countA && valid; j++ ){
+				unsigned int corners[3];
+				for ( int k=0; k<3; k++ )
+					corners[k] = remap[ out_indices[trianglesA[j]*3+k] ];
+				if ( corners[0] == corners[1] || corners[1] == corners[2] || corners[0] == corners[2] )
+					continue; // Already gone
+				if ( corners[0] == b || corners[1] == b || corners[2] == b )
+					continue; // Goes away with this collapse
+				glm::vec3 p[3], q[3];
+				for ( int k=0; k<3; k++ ){
+					p[k] = vertices[ corners[k] ];
+					q[k] = corners[k] == a ? vertices[b] : p[k];
+				}
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after  = glm::cross(q[1] - q[0], q[2] - q[0]);
+				if ( glm::dot(before, after) <= 0.0f )
+					valid = false;
+			}
+			if ( !valid )
+				continue;
+
+			touched[a] = 1;
+			touched[b] = 1;
+			remap[a] = b;
+			addQuadric(quadrics[b], quadrics[a]);
+			maxError = std::max(maxError, collapses[i].error);
+			collapsed++;
+		}
+		if ( collapsed == 0 )
+			break; // Everything left is locked or would fold over
+
+		// Apply the collapses and drop the triangles that became degenerate
+		size_t written = 0;
+		for ( size_t t=0; t<triangleCount; t++ ){
+			IndexType c0 = (IndexType)remap[ out_indices[t*3] ];
+			IndexType c1 = (IndexType)remap[ out_indices[t*3+1] ];
+			IndexType c2 = (IndexType)remap[ out_indices[t*3+2] ];
+			if ( c0 == c1 || c1 == c2 || c0 == c2 )
+				continue;
+			out_indices[written++] = c0;
+			out_indices[written++] = c1;
+			out_indices[written++] = c2;
+		}
+		out_indices.resize(written);
+	}
+
+	return (float)sqrt(maxError);
+}
+
+template float simplifyMesh<unsigned short>(const std::vector<unsigned short> &, const std::vector<glm::vec3> &, const std::vector<glm::vec2> &, size_t, std::vector<unsigned short> &);
+template float simplifyMesh<unsigned int>(const std::vector<unsigned int> &, const std::vector<glm::vec3> &, const std::vector<glm::vec2> &, size_t, std::vector<unsigned int> &);
@@ -0,0 +1,25 @@
+#ifndef VBOSIMPLIFIER_HPP
+#define VBOSIMPLIFIER_HPP
+
+// Builds a coarser version of an indexed triangle list by collapsing edges
+// in the order of their quadric error (Garland & Heckbert, "Surface
+// Simplification Using Quadric Error Metrics").
+// Vertices only ever collapse onto one of their neighbours, so the result
+// indexes the same vertex buffer : all the LODs of a mesh can share it.
+// Vertices on a UV seam (a position shared by vertices with different
+// uvs) or on an open border never move, so seams and outlines stay intact.
+// Normal seams are ignored : a LOD triangle may use a vertex with the right
+// position and uv but another face's normal. IndexType is unsigned short
+// or unsigned int.
+// Stops at targetIndexCount or when nothing can be collapsed anymore, and
+// returns the error of the result in model units.
+template <typename IndexType>
+float simplifyMesh(
+	const std::vector<IndexType> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	size_t targetIndexCount,
+	std::vector<IndexType> & out_indices
+);
+
+#endif
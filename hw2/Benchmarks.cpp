@@ -0,0 +1,315 @@
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <common/jobsystem.hpp>
+#include <common/trsbatch.hpp>
+#include <common/objloader.hpp>
+#include <common/vboindexer.hpp>
+#include <common/meshcache.hpp>
+#include <common/vboquantizer.hpp>
+
+#include "Target.hpp"
+#include "Fireball.hpp"
+#include "EntityStore.hpp"
+#include "InstanceBatch.hpp"
+#include "Benchmarks.hpp"
+
+// Times one simulation step and the instance data of one frame for
+// kBenchmarkEntities targets and as many fireballs, for 1, 2, 4 ... threads.
+// No window : only the CPU side is measured.
+static int run_update_benchmark() {
+    constexpr size_t kBenchmarkEntities = 100000;
+    constexpr int kFrames = 100;
+    constexpr GLfloat kStep = 1.0f / 120.0f;
+
+    // Fireballs start 3 units from the origin and die past 10, so every
+    // round starts over from the same stores instead of timing what is left
+    EntityStore targets(kBenchmarkEntities);
+    EntityStore fireballs(kBenchmarkEntities);
+    auto spawn_entities = [&] {
+        targets.clear();
+        fireballs.clear();
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<GLfloat> unit(-1.0f, 1.0f);
+        for (size_t i = 0; i < kBenchmarkEntities; ++i) {
+            glm::vec3 direction = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) +
+                                                 glm::vec3(0.0f, 0.0f, 2.0f));
+            Target::spawn(targets, direction * 5.0f);
+            Fireball::spawn(fireballs, -direction * 3.0f, direction);
+        }
+    };
+    std::vector<InstanceData> instances(2 * kBenchmarkEntities);
+
+    unsigned int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    double single_thread_ms = 0.0;
+    for (unsigned int thread_count = 1;; thread_count = std::min(thread_count * 2, max_threads)) {
+        JobSystem jobs(thread_count);
+        spawn_entities();
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < kFrames; ++frame) {
+            Target::update(targets, kStep, jobs);
+            Fireball::update(fireballs, kStep, jobs);
+            // Never past what is alive, should a fireball still die
+            size_t target_count = targets.size();
+            size_t fireball_count = fireballs.size();
+            jobs.parallelFor(0, std::max(target_count, fireball_count), EntityStore::kJobGrainSize,
+                             [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    if (i < target_count) {
+                        instances[i] = Target::get_instance(targets, i, 0.5f);
+                    }
+                    if (i < fireball_count) {
+                        instances[kBenchmarkEntities + i] = Fireball::get_instance(fireballs, i, 0.5f);
+                    }
+                }
+            });
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / kFrames;
+        if (thread_count == 1) {
+            single_thread_ms = ms;
+        }
+        printf("%2u threads : %7.3f ms per frame (x%.2f), %zu fireballs left\n", thread_count, ms,
+               single_thread_ms / ms, fireballs.size());
+        if (thread_count == max_threads) {
+            break;
+        }
+    }
+    return 0;
+}
+
+// Model matrices of kBenchmarkEntities objects : three glm::mat4 and two
+// products each, like the per-object path used to, against buildTrsMatrices
+static int run_transform_benchmark() {
+    constexpr size_t kBenchmarkEntities = 100000;
+    constexpr int kRuns = 100;
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<GLfloat> coordinate(-10.0f, 10.0f);
+    std::uniform_real_distribution<GLfloat> angle(-glm::pi<GLfloat>(), glm::pi<GLfloat>());
+    TrsArrays inputs;
+    resizeTrsArrays(inputs, kBenchmarkEntities);
+    for (size_t i = 0; i < kBenchmarkEntities; ++i) {
+        inputs.x[i] = coordinate(rng);
+        inputs.y[i] = coordinate(rng);
+        inputs.z[i] = coordinate(rng);
+        inputs.angles[i] = angle(rng);
+        inputs.scales[i] = 1 / glm::length(glm::vec3(inputs.x[i], inputs.y[i], inputs.z[i]));
+    }
+
+    std::vector<glm::mat4> glm_matrices(kBenchmarkEntities);
+    std::vector<AffineMatrix> matrices;
+    auto time_ms = [&](const std::function<void()> &build) {
+        auto start = std::chrono::steady_clock::now();
+        for (int run = 0; run < kRuns; ++run) {
+            build();
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / kRuns;
+    };
+    double glm_ms = time_ms([&] {
+        for (size_t i = 0; i < kBenchmarkEntities; ++i) {
+            GLfloat scale = inputs.scales[i];
+            glm_matrices[i] = glm::translate(glm::mat4(), glm::vec3(inputs.x[i], inputs.y[i], inputs.z[i])) *
+                              glm::rotate(glm::mat4(1.0f), inputs.angles[i], glm::vec3(0, 0, 1)) *
+                              glm::scale(glm::mat4(), glm::vec3(scale, scale, scale));
+        }
+    });
+    double scalar_ms = time_ms([&] { buildTrsMatrices_scalar(inputs, matrices); });
+    double batched_ms = time_ms([&] { buildTrsMatrices(inputs, matrices); });
+
+    GLfloat max_error = 0.0f;
+    for (size_t i = 0; i < kBenchmarkEntities; ++i) {
+        for (int row = 0; row < 3; ++row) {
+            for (int column = 0; column < 4; ++column) {
+                max_error = std::max(max_error, std::abs(glm_matrices[i][column][row] - matrices[i].rows[row][column]));
+            }
+        }
+    }
+    printf("TRS matrices of %zu objects : glm %.3f ms, scalar %.3f ms, batched %.3f ms (x%.1f), max error %g\n",
+           kBenchmarkEntities, glm_ms, scalar_ms, batched_ms, glm_ms / batched_ms, max_error);
+    return 0;
+}
+
+// The fscanf loader against the mapped one, serial and on every core, on
+// ball.obj repeated kCopies times. Faces of a copy still point at the first
+// one, which keeps the file valid. Returns 1 if the outputs differ.
+static int run_obj_benchmark() {
+    constexpr int kCopies = 400;
+    constexpr int kRuns = 3;
+    const char *source_path = "assets/ball.obj";
+    const char *large_path = "obj_benchmark.obj";
+
+    std::vector<char> source;
+    FILE *source_file = fopen(source_path, "rb");
+    if (source_file == nullptr) {
+        std::cerr << "Can't open " << source_path << std::endl;
+        return 1;
+    }
+    char chunk[1 << 16];
+    for (size_t read; (read = fread(chunk, 1, sizeof(chunk), source_file)) > 0;) {
+        source.insert(source.end(), chunk, chunk + read);
+    }
+    fclose(source_file);
+    FILE *large_file = fopen(large_path, "wb");
+    if (large_file == nullptr) {
+        std::cerr << "Can't write " << large_path << std::endl;
+        return 1;
+    }
+    for (int copy = 0; copy < kCopies; ++copy) {
+        fwrite(source.data(), 1, source.size(), large_file);
+    }
+    fclose(large_file);
+    double megabytes = static_cast<double>(source.size()) * kCopies / (1024.0 * 1024.0);
+
+    typedef std::function<bool(std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &)> Loader;
+    std::vector<std::pair<const char *, Loader>> loaders = {
+            {"loadOBJ_slow", [&](std::vector<glm::vec3> &v, std::vector<glm::vec2> &uv, std::vector<glm::vec3> &n) {
+                return loadOBJ_slow(large_path, v, uv, n);
+            }},
+            {"loadOBJ", [&](std::vector<glm::vec3> &v, std::vector<glm::vec2> &uv, std::vector<glm::vec3> &n) {
+                return loadOBJ(large_path, v, uv, n);
+            }},
+            {"loadOBJ_parallel", [&](std::vector<glm::vec3> &v, std::vector<glm::vec2> &uv, std::vector<glm::vec3> &n) {
+                return loadOBJ_parallel(large_path, v, uv, n);
+            }},
+    };
+
+    int result = 0;
+    std::vector<glm::vec3> reference_vertices, reference_normals;
+    std::vector<glm::vec2> reference_uvs;
+    std::vector<std::pair<const char *, double>> timings;
+    for (size_t l = 0; l < loaders.size(); ++l) {
+        double best_ms = HUGE_VAL;
+        std::vector<glm::vec3> vertices, normals;
+        std::vector<glm::vec2> uvs;
+        for (int run = 0; run < kRuns; ++run) {
+            vertices.clear();
+            uvs.clear();
+            normals.clear();
+            auto start = std::chrono::steady_clock::now();
+            bool loaded = loaders[l].second(vertices, uvs, normals);
+            best_ms = std::min(best_ms, std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count());
+            if (!loaded) {
+                std::cerr << loaders[l].first << " failed" << std::endl;
+                result = 1;
+                break;
+            }
+        }
+        if (l == 0) {
+            reference_vertices.swap(vertices);
+            reference_uvs.swap(uvs);
+            reference_normals.swap(normals);
+        } else if (vertices != reference_vertices || uvs != reference_uvs || normals != reference_normals) {
+            std::cerr << loaders[l].first << " differs from " << loaders[0].first << std::endl;
+            result = 1;
+        }
+        timings.emplace_back(loaders[l].first, best_ms);
+    }
+    remove(large_path);
+
+    for (const auto &timing : timings) {
+        printf("%-16s : %.2f MB in %8.2f ms (%6.1f MB/s)\n", timing.first, megabytes, timing.second,
+               megabytes / (timing.second / 1000.0));
+    }
+    return result;
+}
+
+// indexVBO against the std::map version it replaced, on a grid of
+// kBenchmarkTriangles triangles given as a triangle soup. The map's 16-bit
+// indices wrap, so they are compared modulo 65536. Returns 1 if the
+// outputs differ.
+static int run_indexer_benchmark() {
+    constexpr size_t kBenchmarkTriangles = 1000000;
+    const size_t side = static_cast<size_t>(std::sqrt(kBenchmarkTriangles / 2.0));
+
+    std::vector<glm::vec3> vertices, normals;
+    std::vector<glm::vec2> uvs;
+    auto add_corner = [&](size_t x, size_t y) {
+        glm::vec2 uv(static_cast<GLfloat>(x) / side, static_cast<GLfloat>(y) / side);
+        vertices.push_back(glm::vec3(uv.x, std::sin(uv.x * 10.0f) * std::cos(uv.y * 10.0f), uv.y));
+        uvs.push_back(uv);
+        normals.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
+    };
+    for (size_t y = 0; y < side; ++y) {
+        for (size_t x = 0; x < side; ++x) {
+            add_corner(x, y);
+            add_corner(x + 1, y);
+            add_corner(x + 1, y + 1);
+            add_corner(x, y);
+            add_corner(x + 1, y + 1);
+            add_corner(x, y + 1);
+        }
+    }
+
+    std::vector<unsigned short> map_indices;
+    std::vector<glm::vec3> map_vertices, map_normals;
+    std::vector<glm::vec2> map_uvs;
+    auto start = std::chrono::steady_clock::now();
+    indexVBO_map(vertices, uvs, normals, map_indices, map_vertices, map_uvs, map_normals);
+    double map_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    VboIndexBuffer hash_indices;
+    std::vector<glm::vec3> hash_vertices, hash_normals;
+    std::vector<glm::vec2> hash_uvs;
+    start = std::chrono::steady_clock::now();
+    indexVBO(vertices, uvs, normals, hash_indices, hash_vertices, hash_uvs, hash_normals);
+    double hash_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    bool same = hash_vertices == map_vertices && hash_uvs == map_uvs && hash_normals == map_normals &&
+                hash_indices.size() == map_indices.size();
+    for (size_t i = 0; same && i < map_indices.size(); ++i) {
+        unsigned int index = hash_indices.wide ? hash_indices.indices32[i] : hash_indices.indices16[i];
+        same = static_cast<unsigned short>(index) == map_indices[i];
+    }
+    printf("indexVBO on %zu triangles, %zu unique vertices : std::map %.1f ms, hash %.1f ms (x%.1f), "
+           "%u-bit indices%s\n", vertices.size() / 3, hash_vertices.size(), map_ms, hash_ms, map_ms / hash_ms,
+           hash_indices.wide ? 32u : 16u, same ? "" : " - OUTPUTS DIFFER");
+    return same ? 0 : 1;
+}
+
+// What quantizeVertices loses on the game's meshes, in model units and
+// degrees. Returns 1 if a mesh can't be loaded.
+static int run_quantization_report() {
+    int result = 0;
+    for (const char *path : {"assets/target.obj", "assets/ball.obj"}) {
+        MeshBin mesh;
+        if (!loadMeshBin(path, mesh)) {
+            std::cerr << "Can't load " << path << std::endl;
+            result = 1;
+            continue;
+        }
+        std::vector<glm::vec3> vertices(mesh.positions, mesh.positions + mesh.vertexCount);
+        std::vector<glm::vec2> uvs(mesh.uvs, mesh.uvs + mesh.vertexCount);
+        std::vector<glm::vec3> normals(mesh.normals, mesh.normals + mesh.vertexCount);
+        closeMeshBin(mesh);
+
+        std::vector<QuantizedVertex> quantized;
+        QuantizationParams params;
+        quantizeVertices(vertices, uvs, normals, quantized, params);
+        printQuantizationError(path, measureQuantizationError(vertices, uvs, normals, quantized, params),
+                               quantized.size());
+    }
+    return result;
+}
+
+int run_benchmarks() {
+    // All of them run, whichever fails
+    int failures = 0;
+    failures += run_obj_benchmark();
+    failures += run_indexer_benchmark();
+    failures += run_transform_benchmark();
+    failures += run_update_benchmark();
+    failures += run_quantization_report();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,11 @@
+#ifndef HW2_BENCHMARKS
+#define HW2_BENCHMARKS
+
+// Times the library code the game runs on : the OBJ loaders, the indexer,
+// the TRS batching and the entity update on the job system, and reports the
+// vertex quantization error of the game's meshes. No window.
+// Each also checks its result against the code it replaced; returns 1 if
+// any of them failed, after running all of them.
+int run_benchmarks();
+
+#endif //HW2_BENCHMARKS
@@ -0,0 +1,85 @@
+#include <cmath>
+
+#include "CollisionGrid.hpp"
+
+static GLint grid_cell(GLfloat x, GLfloat cell_size) {
+    return static_cast<GLint>(std::floor(x / cell_size));
+}
+
+size_t CollisionGrid::find_bucket(GLint x, GLint y, GLint z) const {
+    unsigned long long h = static_cast<unsigned long long>(x) * 73856093ull ^
+                           static_cast<unsigned long long>(y) * 19349663ull ^
+                           static_cast<unsigned long long>(z) * 83492791ull;
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 32;
+    return static_cast<size_t>(h) & bucket_mask_;
+}
+
+void CollisionGrid::build(const EntityStore &targets) {
+    size_t bucket_count = 16;
+    while (bucket_count < 2 * targets.size()) {
+        bucket_count *= 2;
+    }
+    bucket_mask_ = bucket_count - 1;
+    first_in_bucket_.assign(bucket_count, kNone);
+    next_in_bucket_.resize(targets.size());
+
+    // Insert backwards, so that each chain lists its targets in order
+    for (size_t i = targets.size(); i-- > 0;) {
+        glm::vec3 p = targets.get_positions()[i];
+        size_t bucket = find_bucket(grid_cell(p.x, kCellSize), grid_cell(p.y, kCellSize), grid_cell(p.z, kCellSize));
+        next_in_bucket_[i] = first_in_bucket_[bucket];
+        first_in_bucket_[bucket] = static_cast<unsigned int>(i);
+    }
+}
+
+size_t CollisionGrid::resolve(EntityStore &fireballs, EntityStore &targets) {
+    if (fireballs.empty() || targets.empty()) {
+        return 0;
+    }
+    build(targets);
+    target_hit_.assign(targets.size(), 0);
+    fireball_hit_.assign(fireballs.size(), 0);
+
+    size_t hits = 0;
+    for (size_t i = 0; i < fireballs.size(); ++i) {
+        glm::vec3 pos = fireballs.get_current_position(i);
+        GLint cx = grid_cell(pos.x, kCellSize);
+        GLint cy = grid_cell(pos.y, kCellSize);
+        GLint cz = grid_cell(pos.z, kCellSize);
+        for (GLint dx = -1; dx <= 1; ++dx) {
+            for (GLint dy = -1; dy <= 1; ++dy) {
+                for (GLint dz = -1; dz <= 1; ++dz) {
+                    // Different cells may share a bucket : the distance test
+                    // below sorts them out
+                    size_t bucket = find_bucket(cx + dx, cy + dy, cz + dz);
+                    for (unsigned int j = first_in_bucket_[bucket]; j != kNone; j = next_in_bucket_[j]) {
+                        if (!target_hit_[j] && Target::is_close_to_point(targets.get_positions()[j], pos)) {
+                            target_hit_[j] = 1;
+                            fireball_hit_[i] = 1;
+                            ++hits;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    if (hits == 0) {
+        return 0;
+    }
+
+    // Deferred removal. Backwards, so that the entity swapped in has already
+    // been looked at.
+    for (size_t j = targets.size(); j-- > 0;) {
+        if (target_hit_[j]) {
+            targets.destroy_at(j);
+        }
+    }
+    for (size_t i = fireballs.size(); i-- > 0;) {
+        if (fireball_hit_[i]) {
+            fireballs.destroy_at(i);
+        }
+    }
+    return hits;
+}
@@ -0,0 +1,43 @@
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "EntityStore.hpp"
+#include "Target.hpp"
+
+#ifndef HW2_COLLISION_GRID
+#define HW2_COLLISION_GRID
+
+// Fireball / target collisions through a uniform grid. The targets are
+// hashed into cells as large as the hit radius, so a fireball only has to
+// look at the targets of the 27 cells around it.
+class CollisionGrid {
+public:
+    // Removes the targets hit by a fireball and the fireballs that hit
+    // something, and returns the number of targets hit. Same result as
+    // testing every fireball, in store order, against every target still
+    // alive : a target hit by a fireball can't be hit again by a later one.
+    size_t resolve(EntityStore &fireballs, EntityStore &targets);
+
+private:
+    void build(const EntityStore &targets);
+
+    size_t find_bucket(GLint x, GLint y, GLint z) const;
+
+private:
+    // Buckets of the hash, chained through the targets
+    std::vector<unsigned int> first_in_bucket_;
+    std::vector<unsigned int> next_in_bucket_;
+    size_t bucket_mask_ = 0;
+
+    // Removals are deferred to the end of resolve
+    std::vector<char> target_hit_;
+    std::vector<char> fireball_hit_;
+
+private:
+    constexpr static unsigned int kNone = ~0u;
+    constexpr static GLfloat kCellSize = Target::kHitRadius;
+};
+
+#endif //HW2_COLLISION_GRID
@@ -0,0 +1,41 @@
+#include "EntityRenderer.hpp"
+
+EntityRenderer::EntityRenderer(GLuint programID, const Mesh &mesh, GLuint textureID, GetEntityInstance get_instance) :
+        material_(make_material(programID, mesh, textureID)),
+        get_instance_(get_instance) {
+}
+
+void EntityRenderer::record(const EntityStore &store, const std::vector<size_t> &indices, RenderQueue &queue,
+                            const LodView &view, GLfloat alpha) const {
+    const Mesh &mesh = *material_.mesh;
+
+    // All the model matrices at once
+    resizeTrsArrays(transform_inputs_, indices.size());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        InstanceData instance = get_instance_(store, indices[i], alpha);
+        transform_inputs_.x[i] = instance.position.x;
+        transform_inputs_.y[i] = instance.position.y;
+        transform_inputs_.z[i] = instance.position.z;
+        transform_inputs_.angles[i] = instance.spin_angle;
+        transform_inputs_.scales[i] = instance.scale;
+    }
+    buildTrsMatrices(transform_inputs_, transforms_);
+
+    for (size_t i = 0; i < indices.size(); ++i) {
+        const AffineMatrix &rotation_matrix = transforms_[i];
+
+        // Fewer triangles when far away
+        glm::vec3 position(transform_inputs_.x[i], transform_inputs_.y[i], transform_inputs_.z[i]);
+        glm::vec3 camera_modelspace = inverseTransformTrs(rotation_matrix, view.camera_position);
+        queue.push(material_, rotation_matrix, camera_modelspace,
+                   mesh.select_lod(position, transform_inputs_.scales[i], view),
+                   glm::distance(position, view.camera_position));
+    }
+}
+
+void EntityRenderer::add_to(const EntityStore &store, const std::vector<size_t> &indices,
+                            GetEntityInstance get_instance, InstanceBatch &batch, const LodView &view, GLfloat alpha,
+                            JobSystem &jobs) {
+    batch.set_instances(jobs, indices.size(), [&](size_t i) { return get_instance(store, indices[i], alpha); },
+                        view);
+}
@@ -0,0 +1,44 @@
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include <common/jobsystem.hpp>
+#include <common/trsbatch.hpp>
+
+#include "Mesh.hpp"
+#include "EntityStore.hpp"
+#include "InstanceBatch.hpp"
+#include "RenderQueue.hpp"
+
+#ifndef HW2_ENTITY_RENDERER
+#define HW2_ENTITY_RENDERER
+
+// Where the entity at an index of the store is drawn, alpha blending the
+// last two simulation steps : Target::get_instance, Fireball::get_instance
+using GetEntityInstance = InstanceData (*)(const EntityStore &store, size_t index, GLfloat alpha);
+
+// Draws entities of an EntityStore with one material, on either path :
+// one draw per entity through a RenderQueue, or an InstanceBatch.
+class EntityRenderer {
+public:
+    EntityRenderer(GLuint programID, const Mesh &mesh, GLuint textureID, GetEntityInstance get_instance);
+
+    // Queues one draw for each of the entities at these indices
+    void record(const EntityStore &store, const std::vector<size_t> &indices, RenderQueue &queue,
+                const LodView &view, GLfloat alpha) const;
+
+    // Hands the entities at these indices to the batch instead of drawing them
+    static void add_to(const EntityStore &store, const std::vector<size_t> &indices, GetEntityInstance get_instance,
+                       InstanceBatch &batch, const LodView &view, GLfloat alpha, JobSystem &jobs);
+
+private:
+    Material material_;
+    GetEntityInstance get_instance_;
+
+    // Model matrices of the per-object path, rebuilt on every record
+    mutable TrsArrays transform_inputs_;
+    mutable std::vector<AffineMatrix> transforms_;
+};
+
+#endif //HW2_ENTITY_RENDERER
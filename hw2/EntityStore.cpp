@@ -0,0 +1,156 @@
+#include <glm/gtc/constants.hpp>
+
+#include "EntityStore.hpp"
+
+EntityStore::EntityStore(size_t capacity) :
+        slot_indices_(capacity, 0),
+        slot_generations_(capacity, 0) {
+    positions_.reserve(capacity);
+    directions_.reserve(capacity);
+    distances_.reserve(capacity);
+    spin_angles_.reserve(capacity);
+    previous_distances_.reserve(capacity);
+    previous_spin_angles_.reserve(capacity);
+    slots_.reserve(capacity);
+
+    // Hand out the low slots first
+    free_slots_.reserve(capacity);
+    for (size_t slot = capacity; slot-- > 0;) {
+        free_slots_.push_back(static_cast<uint32_t>(slot));
+    }
+}
+
+EntityHandle EntityStore::create(glm::vec3 position, glm::vec3 direction, GLfloat distance) {
+    if (free_slots_.empty()) {
+        return {kNoSlot, 0};
+    }
+    uint32_t slot = free_slots_.back();
+    free_slots_.pop_back();
+    slot_indices_[slot] = static_cast<uint32_t>(positions_.size());
+
+    positions_.push_back(position);
+    directions_.push_back(direction);
+    distances_.push_back(distance);
+    spin_angles_.push_back(0.0f);
+    previous_distances_.push_back(distance);
+    previous_spin_angles_.push_back(0.0f);
+    slots_.push_back(slot);
+    return {slot, slot_generations_[slot]};
+}
+
+void EntityStore::destroy_at(size_t index) {
+    uint32_t slot = slots_[index];
+    size_t last = positions_.size() - 1;
+    if (index != last) {
+        positions_[index] = positions_[last];
+        directions_[index] = directions_[last];
+        distances_[index] = distances_[last];
+        spin_angles_[index] = spin_angles_[last];
+        previous_distances_[index] = previous_distances_[last];
+        previous_spin_angles_[index] = previous_spin_angles_[last];
+        slots_[index] = slots_[last];
+        slot_indices_[slots_[index]] = static_cast<uint32_t>(index);
+    }
+    positions_.pop_back();
+    directions_.pop_back();
+    distances_.pop_back();
+    spin_angles_.pop_back();
+    previous_distances_.pop_back();
+    previous_spin_angles_.pop_back();
+    slots_.pop_back();
+
+    // Old handles to this slot are dead from now on
+    ++slot_generations_[slot];
+    free_slots_.push_back(slot);
+}
+
+void EntityStore::destroy(EntityHandle handle) {
+    if (is_alive(handle)) {
+        destroy_at(slot_indices_[handle.slot]);
+    }
+}
+
+bool EntityStore::is_alive(EntityHandle handle) const {
+    return handle.slot != kNoSlot && slot_generations_[handle.slot] == handle.generation;
+}
+
+size_t EntityStore::index_of(EntityHandle handle) const {
+    return slot_indices_[handle.slot];
+}
+
+EntityHandle EntityStore::handle_at(size_t index) const {
+    uint32_t slot = slots_[index];
+    return {slot, slot_generations_[slot]};
+}
+
+size_t EntityStore::size() const {
+    return positions_.size();
+}
+
+bool EntityStore::empty() const {
+    return positions_.empty();
+}
+
+bool EntityStore::full() const {
+    return free_slots_.empty();
+}
+
+size_t EntityStore::capacity() const {
+    return slot_indices_.size();
+}
+
+void EntityStore::clear() {
+    while (!empty()) {
+        destroy_at(size() - 1);
+    }
+}
+
+glm::vec3 EntityStore::get_current_position(size_t index) const {
+    return directions_[index] * distances_[index] + positions_[index];
+}
+
+void EntityStore::save_previous() {
+    previous_distances_ = distances_;
+    previous_spin_angles_ = spin_angles_;
+}
+
+glm::vec3 EntityStore::get_interpolated_position(size_t index, GLfloat alpha) const {
+    GLfloat distance = previous_distances_[index] + (distances_[index] - previous_distances_[index]) * alpha;
+    return directions_[index] * distance + positions_[index];
+}
+
+GLfloat EntityStore::get_interpolated_spin_angle(size_t index, GLfloat alpha) const {
+    // The angles wrap around at +-pi : go the short way
+    const GLfloat pi = glm::pi<GLfloat>();
+    GLfloat delta = spin_angles_[index] - previous_spin_angles_[index];
+    if (delta > pi) {
+        delta -= 2 * pi;
+    } else if (delta < -pi) {
+        delta += 2 * pi;
+    }
+    return previous_spin_angles_[index] + delta * alpha;
+}
+
+const std::vector<glm::vec3> &EntityStore::get_positions() const {
+    return positions_;
+}
+
+const std::vector<glm::vec3> &EntityStore::get_directions() const {
+    return directions_;
+}
+
+std::vector<GLfloat> &EntityStore::get_distances() {
+    return distances_;
+}
+
+const std::vector<GLfloat> &EntityStore::get_distances() const {
+    return distances_;
+}
+
+std::vector<GLfloat> &EntityStore::get_spin_angles() {
+    return spin_angles_;
+}
+
+const std::vector<GLfloat> &EntityStore::get_spin_angles() const {
+    return spin_angles_;
+}
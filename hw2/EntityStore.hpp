@@ -0,0 +1,96 @@
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#ifndef HW2_ENTITY_STORE
+#define HW2_ENTITY_STORE
+
+// Refers to an entity of an EntityStore. Stays valid, and keeps referring
+// to the same entity, whatever is removed around it.
+struct EntityHandle {
+    uint32_t slot;
+    uint32_t generation;
+};
+
+// Entities moving along a straight line and spinning around Z, stored as
+// one array per field (structure of arrays) so that the update loops run
+// over contiguous memory. Entities live at indices 0 .. size() - 1, in no
+// particular order : removing one moves the last entity into its place.
+// All the memory is allocated up front for a fixed capacity, so creating
+// an entity only recycles a slot : no heap allocation.
+class EntityStore {
+public:
+    explicit EntityStore(size_t capacity);
+
+    // The entity is at position + direction * distance. When the store is
+    // full, nothing is created and the handle is never alive.
+    EntityHandle create(glm::vec3 position, glm::vec3 direction, GLfloat distance);
+
+    // O(1), but moves the last entity to index
+    void destroy_at(size_t index);
+
+    void destroy(EntityHandle handle);
+
+    bool is_alive(EntityHandle handle) const;
+
+    size_t index_of(EntityHandle handle) const;
+
+    EntityHandle handle_at(size_t index) const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    bool full() const;
+
+    size_t capacity() const;
+
+    void clear();
+
+    glm::vec3 get_current_position(size_t index) const;
+
+    // Remembers the current state as the previous one. Called before every
+    // simulation step, so that rendering can blend the last two steps.
+    void save_previous();
+
+    // Between the previous state (alpha = 0) and the current one (alpha = 1)
+    glm::vec3 get_interpolated_position(size_t index, GLfloat alpha) const;
+
+    GLfloat get_interpolated_spin_angle(size_t index, GLfloat alpha) const;
+
+    const std::vector<glm::vec3> &get_positions() const;
+
+    const std::vector<glm::vec3> &get_directions() const;
+
+    std::vector<GLfloat> &get_distances();
+
+    const std::vector<GLfloat> &get_distances() const;
+
+    std::vector<GLfloat> &get_spin_angles();
+
+    const std::vector<GLfloat> &get_spin_angles() const;
+
+    // Entities per job when a loop over them is spread over threads
+    constexpr static size_t kJobGrainSize = 2048;
+
+private:
+    // Dense arrays, one entry per live entity
+    std::vector<glm::vec3> positions_;
+    std::vector<glm::vec3> directions_;
+    std::vector<GLfloat> distances_;
+    std::vector<GLfloat> spin_angles_;
+    std::vector<GLfloat> previous_distances_;
+    std::vector<GLfloat> previous_spin_angles_;
+    std::vector<uint32_t> slots_;
+
+    // Sparse side : what each handle slot points to
+    std::vector<uint32_t> slot_indices_;
+    std::vector<uint32_t> slot_generations_;
+    std::vector<uint32_t> free_slots_;
+
+    constexpr static uint32_t kNoSlot = ~0u;
+};
+
+#endif //HW2_ENTITY_STORE
@@ -1,86 +1,47 @@
 #include "Fireball.hpp"
 
-Fireball::Fireball(GLuint programID, GLuint vertexbuffer, GLuint uvbuffer, size_t vertex_count) :
-        program_id_(programID),
-        vertex_buffer_id_(vertexbuffer),
-        uv_buffer_id_(uvbuffer),
-        vertex_count_(vertex_count) {
-    matrix_location_ = glGetUniformLocation(programID, "MVP");
-    rotate_location_ = glGetUniformLocation(programID, "rotation_matrix");
-    texture_location_ = glGetUniformLocation(programID, "myTextureSampler");
+Fireball::Fireball(GLuint programID, const Mesh &mesh, GLuint textureID) :
+        renderer_(programID, mesh, textureID, get_instance) {
 }
 
-void Fireball::set_move_direction(glm::vec3 move_direction) {
-    move_direction_ = glm::normalize(move_direction);
+EntityHandle Fireball::spawn(EntityStore &fireballs, glm::vec3 coordinates, glm::vec3 move_direction) {
+    return fireballs.create(coordinates, glm::normalize(move_direction), kLaunchDistance);
 }
 
-void Fireball::set_coordinates(glm::vec3 coordinates) {
-    coordinates_ = coordinates;
-}
-
-void Fireball::set_texture_id(GLuint textureID) {
-    texture_id = textureID;
-}
-
-glm::vec3 Fireball::get_current_position() {
-    return move_direction_ * dist_to_launch_point_ + coordinates_;
+void Fireball::update(EntityStore &fireballs, GLfloat dt, JobSystem &jobs) {
+    std::vector<GLfloat> &distances = fireballs.get_distances();
+    std::vector<GLfloat> &spin_angles = fireballs.get_spin_angles();
+    jobs.parallelFor(0, fireballs.size(), EntityStore::kJobGrainSize, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            distances[i] += kSpeed * dt;
+            GLfloat angle = spin_angles[i] + kSpinSpeed * dt;
+
+            // Normalize angle, so that -pi <= angle <= pi
+            GLint n = angle / kPi;
+            spin_angles[i] = angle - 2 * kPi * n;
+        }
+    });
+
+    // Backwards, so that the entity swapped in has already been looked at
+    for (size_t i = fireballs.size(); i-- > 0;) {
+        if (1 / glm::length(fireballs.get_current_position(i)) < kMinScale) {
+            fireballs.destroy_at(i);
+        }
+    }
 }
 
-bool Fireball::calculate_rotation_matrix(glm::mat4 &rotation_matrix) {
-    dist_to_launch_point_ += kDistStep;
-    current_spin_angle_ += kAngleStep;
-
-    // Normalize angle, so that -pi <= angle <= pi
-    GLint n = current_spin_angle_ / kPi;
-    current_spin_angle_ -= 2 * kPi * n;
-
+InstanceData Fireball::get_instance(const EntityStore &fireballs, size_t index, GLfloat alpha) {
     // Scale model, so that distant objects look smaller
-    glm::vec3 current_position = get_current_position();
-    GLfloat scale = 1 / glm::length(current_position);
-    if (scale < 0.1) {
-        return false;
-    }
-    rotation_matrix = glm::translate(glm::mat4(), current_position) *
-                      glm::rotate(glm::mat4(1.0f), current_spin_angle_, glm::vec3(0, 0, 1)) *
-                      glm::scale(glm::mat4(), glm::vec3(scale, scale, scale));
-    return true;
+    glm::vec3 current_position = fireballs.get_interpolated_position(index, alpha);
+    return {current_position, fireballs.get_interpolated_spin_angle(index, alpha), 1 / glm::length(current_position)};
 }
 
-void Fireball::enable_attribute_buffer(size_t attribute_id, size_t attribute_size, GLuint buffer) {
-    glEnableVertexAttribArray(attribute_id);
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glVertexAttribPointer(attribute_id, attribute_size, GL_FLOAT, GL_FALSE, 0, nullptr);
+void Fireball::record(const EntityStore &fireballs, const std::vector<size_t> &indices, RenderQueue &queue,
+                      const LodView &view, GLfloat alpha) const {
+    renderer_.record(fireballs, indices, queue, view, alpha);
 }
 
-bool Fireball::draw(const glm::mat4 &MVP) {
-    glm::mat4 rotation_matrix;
-    bool is_bullet_visible = calculate_rotation_matrix(rotation_matrix);
-    if (!is_bullet_visible) {
-        return false;
-    }
-    // Use our shader
-    glUseProgram(program_id_);
-
-    // Send our transformation to the currently bound shader, in the "MVP" uniform
-    glUniformMatrix4fv(matrix_location_, 1, GL_FALSE, &MVP[0][0]);
-    glUniformMatrix4fv(rotate_location_, 1, GL_FALSE, &rotation_matrix[0][0]);
-
-    // Bind our texture in Texture Unit 0
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture_id);
-    // Set our "myTextureSampler" sampler to use Texture Unit 0
-    glUniform1i(texture_location_, 0);
-
-    // vertices
-    enable_attribute_buffer(0, 3, vertex_buffer_id_);
-    // colors
-    enable_attribute_buffer(1, 2, uv_buffer_id_);
-
-    // Draw triangles
-    glDrawArrays(GL_TRIANGLES, 0, vertex_count_);
-
-    // Disable attribute arrays
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
-    return true;
-}
\ No newline at end of file
+void Fireball::add_to(const EntityStore &fireballs, const std::vector<size_t> &indices, InstanceBatch &batch,
+                      const LodView &view, GLfloat alpha, JobSystem &jobs) {
+    EntityRenderer::add_to(fireballs, indices, get_instance, batch, view, alpha, jobs);
+}
@@ -3,48 +3,50 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <vector>
+
+#include <common/jobsystem.hpp>
+
+#include "Mesh.hpp"
+#include "EntityStore.hpp"
+#include "EntityRenderer.hpp"
+
 #ifndef HW2_BULLET
 #define HW2_BULLET
 
+// How fireballs behave and look. The fireballs themselves live in an
+// EntityStore : flying away from their launch point, spinning around Z.
 class Fireball {
 public:
-    Fireball(GLuint programID, GLuint vertexbuffer, GLuint uvbuffer, size_t vertex_count);
+    Fireball(GLuint programID, const Mesh &mesh, GLuint textureID);
 
-    void set_coordinates(glm::vec3 coordinates);
+    static EntityHandle spawn(EntityStore &fireballs, glm::vec3 coordinates, glm::vec3 move_direction);
 
-    void set_move_direction(glm::vec3 move_direction);
+    // Moves and spins every fireball for dt seconds, and removes the ones
+    // that got too far to be seen
+    static void update(EntityStore &fireballs, GLfloat dt, JobSystem &jobs);
 
-    void set_texture_id(GLuint textureID);
+    // alpha blends the last two simulation steps, see EntityStore
+    static InstanceData get_instance(const EntityStore &fireballs, size_t index, GLfloat alpha);
 
-    glm::vec3 get_current_position();
+    // Queues one draw for each of the fireballs at these indices
+    void record(const EntityStore &fireballs, const std::vector<size_t> &indices, RenderQueue &queue,
+                const LodView &view, GLfloat alpha) const;
 
-    bool draw(const glm::mat4 &MVP);
+    // Hands the fireballs at these indices to the batch instead of drawing them
+    static void add_to(const EntityStore &fireballs, const std::vector<size_t> &indices, InstanceBatch &batch,
+                       const LodView &view, GLfloat alpha, JobSystem &jobs);
 
 private:
-    bool calculate_rotation_matrix(glm::mat4 &rotation_matrix);
-
-    void enable_attribute_buffer(size_t attribute_id, size_t attribute_size, GLuint buffer);
-
-private:
-    glm::vec3 move_direction_;
-    glm::vec3 coordinates_;
-
-    GLint rotate_location_ = 0;
-    GLint matrix_location_ = 0;
-    GLint texture_location_ = 0;
-
-    GLuint vertex_buffer_id_ = 0;
-    GLuint uv_buffer_id_ = 0;
-    GLuint program_id_ = 0;
-    GLuint texture_id = 0;
-
-    GLfloat current_spin_angle_ = 0.0f;
-    GLfloat dist_to_launch_point_ = 1.5f;
-    size_t vertex_count_ = 0;
+    EntityRenderer renderer_;
 
 private:
-    constexpr static GLfloat kDistStep = 0.07f;
-    constexpr static GLfloat kAngleStep = 0.07f;
+    constexpr static GLfloat kLaunchDistance = 1.5f;
+    // Units and radians per second
+    constexpr static GLfloat kSpeed = 4.2f;
+    constexpr static GLfloat kSpinSpeed = 4.2f;
+    // Scale below which a fireball is gone
+    constexpr static GLfloat kMinScale = 0.1f;
     constexpr static auto kPi = glm::pi<GLfloat>();
 };
 
@@ -0,0 +1,83 @@
+#include "GLStateTracker.hpp"
+
+void GLStateTracker::begin_frame() {
+    ++frame_;
+    stats_ = StateChangeStats();
+}
+
+bool GLStateTracker::use_program(GLuint program_id) {
+    if (!count(program_id_ != program_id)) {
+        return false;
+    }
+    glUseProgram(program_id);
+    program_id_ = program_id;
+    return true;
+}
+
+bool GLStateTracker::bind_texture(GLuint unit, GLuint texture_id) {
+    if (!count(texture_ids_[unit] != texture_id)) {
+        return false;
+    }
+    if (active_texture_unit_ != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        active_texture_unit_ = unit;
+    }
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    texture_ids_[unit] = texture_id;
+    return true;
+}
+
+bool GLStateTracker::bind_vertex_array(GLuint vertex_array_id) {
+    if (!count(vertex_array_id_ != vertex_array_id)) {
+        return false;
+    }
+    glBindVertexArray(vertex_array_id);
+    vertex_array_id_ = vertex_array_id;
+    return true;
+}
+
+bool GLStateTracker::need_frame_uniforms(GLuint program_id) {
+    ProgramUniforms &uniforms = find_program(program_id);
+    if (!count(uniforms.frame != frame_)) {
+        return false;
+    }
+    uniforms.frame = frame_;
+    return true;
+}
+
+bool GLStateTracker::need_mesh_uniforms(GLuint program_id, const Mesh &mesh) {
+    ProgramUniforms &uniforms = find_program(program_id);
+    if (!count(uniforms.mesh != &mesh)) {
+        return false;
+    }
+    uniforms.mesh = &mesh;
+    return true;
+}
+
+void GLStateTracker::forget_mesh_uniforms(GLuint program_id) {
+    find_program(program_id).mesh = nullptr;
+}
+
+const StateChangeStats &GLStateTracker::get_stats() const {
+    return stats_;
+}
+
+GLStateTracker::ProgramUniforms &GLStateTracker::find_program(GLuint program_id) {
+    // A handful of programs : a search is all it takes
+    for (ProgramUniforms &uniforms : program_uniforms_) {
+        if (uniforms.program_id == program_id) {
+            return uniforms;
+        }
+    }
+    program_uniforms_.push_back({program_id, frame_ - 1, nullptr});
+    return program_uniforms_.back();
+}
+
+bool GLStateTracker::count(bool changed) {
+    if (changed) {
+        ++stats_.issued;
+    } else {
+        ++stats_.avoided;
+    }
+    return changed;
+}
@@ -0,0 +1,70 @@
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "Mesh.hpp"
+
+#ifndef HW2_GL_STATE_TRACKER
+#define HW2_GL_STATE_TRACKER
+
+// GL calls of the last frame, against the ones that were asked for but
+// already in effect
+struct StateChangeStats {
+    size_t issued = 0;
+    size_t avoided = 0;
+};
+
+// Remembers what is bound, so that asking for it again costs no GL call.
+// Only correct if every program, texture and vertex array change goes
+// through it.
+class GLStateTracker {
+public:
+    // Clears the stats, and makes the per-frame uniforms of every program
+    // stale
+    void begin_frame();
+
+    // Each returns true when it had to change something
+    bool use_program(GLuint program_id);
+    bool bind_texture(GLuint unit, GLuint texture_id);
+    bool bind_vertex_array(GLuint vertex_array_id);
+
+    // Uniforms are state of their program, and outlive the frame. These
+    // return true when the caller has to upload them: the per-frame ones
+    // once per frame, and the dequantization ones when the program holds
+    // another mesh's.
+    bool need_frame_uniforms(GLuint program_id);
+    bool need_mesh_uniforms(GLuint program_id, const Mesh &mesh);
+    // For a caller that uploaded its own values to the dequantization
+    // uniforms : the next need_mesh_uniforms of the program returns true
+    void forget_mesh_uniforms(GLuint program_id);
+
+    const StateChangeStats &get_stats() const;
+
+private:
+    struct ProgramUniforms {
+        GLuint program_id;
+        unsigned int frame;
+        const Mesh *mesh;
+    };
+
+    ProgramUniforms &find_program(GLuint program_id);
+
+    // Counts one request, which needed GL calls or not
+    bool count(bool changed);
+
+private:
+    constexpr static GLuint kUnknown = ~0u;
+    constexpr static GLuint kTextureUnits = 4;
+
+    GLuint program_id_ = kUnknown;
+    GLuint active_texture_unit_ = kUnknown;
+    GLuint texture_ids_[kTextureUnits] = {kUnknown, kUnknown, kUnknown, kUnknown};
+    GLuint vertex_array_id_ = kUnknown;
+
+    std::vector<ProgramUniforms> program_uniforms_;
+    unsigned int frame_ = 0;
+
+    StateChangeStats stats_;
+};
+
+#endif //HW2_GL_STATE_TRACKER
@@ -0,0 +1,192 @@
+#include <algorithm>
+
+#include "GeometryArena.hpp"
+
+void RangeAllocator::reset(size_t capacity) {
+    free_blocks_.clear();
+    capacity_ = 0;
+    grow(capacity);
+}
+
+void RangeAllocator::grow(size_t new_capacity) {
+    if (new_capacity > capacity_) {
+        free(capacity_, new_capacity - capacity_);
+        capacity_ = new_capacity;
+    }
+}
+
+bool RangeAllocator::allocate(size_t size, size_t &out_offset) {
+    for (size_t i = 0; i < free_blocks_.size(); ++i) {
+        Block &block = free_blocks_[i];
+        if (block.size < size) {
+            continue;
+        }
+        out_offset = block.offset;
+        block.offset += size;
+        block.size -= size;
+        if (block.size == 0) {
+            free_blocks_.erase(free_blocks_.begin() + i);
+        }
+        return true;
+    }
+    return false;
+}
+
+void RangeAllocator::free(size_t offset, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    auto next = std::lower_bound(free_blocks_.begin(), free_blocks_.end(), offset,
+                                 [](const Block &block, size_t value) { return block.offset < value; });
+    // Merge with the block before, the block after, or both
+    bool joins_previous = next != free_blocks_.begin() && (next - 1)->offset + (next - 1)->size == offset;
+    bool joins_next = next != free_blocks_.end() && offset + size == next->offset;
+    if (joins_previous && joins_next) {
+        (next - 1)->size += size + next->size;
+        free_blocks_.erase(next);
+    } else if (joins_previous) {
+        (next - 1)->size += size;
+    } else if (joins_next) {
+        next->offset = offset;
+        next->size += size;
+    } else {
+        free_blocks_.insert(next, {offset, size});
+    }
+}
+
+size_t RangeAllocator::get_capacity() const {
+    return capacity_;
+}
+
+size_t RangeAllocator::get_free_size() const {
+    size_t free_size = 0;
+    for (const Block &block : free_blocks_) {
+        free_size += block.size;
+    }
+    return free_size;
+}
+
+size_t RangeAllocator::get_largest_free_block() const {
+    size_t largest = 0;
+    for (const Block &block : free_blocks_) {
+        largest = std::max(largest, block.size);
+    }
+    return largest;
+}
+
+size_t RangeAllocator::get_free_block_count() const {
+    return free_blocks_.size();
+}
+
+void GeometryArena::init(size_t vertex_size, void (*set_pointers)(), size_t vertex_capacity,
+                         size_t index_capacity) {
+    vertex_size_ = vertex_size;
+    set_pointers_ = set_pointers;
+    vertex_allocator_.reset(vertex_capacity);
+    index_allocator_.reset(index_capacity);
+
+    glGenBuffers(1, &vertex_buffer_id_);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_id_);
+    glBufferData(GL_ARRAY_BUFFER, vertex_capacity * vertex_size, nullptr, GL_STATIC_DRAW);
+    glGenBuffers(1, &index_buffer_id_);
+    glBindBuffer(GL_ARRAY_BUFFER, index_buffer_id_);
+    glBufferData(GL_ARRAY_BUFFER, index_capacity * sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+
+    glGenVertexArrays(1, &vertex_array_id_);
+    setup_vertex_array();
+}
+
+void GeometryArena::release() {
+    glDeleteVertexArrays(1, &vertex_array_id_);
+    glDeleteBuffers(1, &vertex_buffer_id_);
+    glDeleteBuffers(1, &index_buffer_id_);
+    vertex_array_id_ = 0;
+    vertex_buffer_id_ = 0;
+    index_buffer_id_ = 0;
+    vertex_allocator_.reset(0);
+    index_allocator_.reset(0);
+}
+
+bool GeometryArena::upload(const void *vertices, size_t vertex_size, size_t vertex_count,
+                           const unsigned int *indices, size_t index_count, GeometryRange &out_range) {
+    if (vertex_size != vertex_size_) {
+        return false;
+    }
+
+    // Double the buffers until the mesh fits. Only loading pays for it.
+    bool grown = false;
+    while (!vertex_allocator_.allocate(vertex_count, out_range.first_vertex)) {
+        size_t capacity = vertex_allocator_.get_capacity();
+        size_t new_capacity = std::max(2 * capacity, capacity + vertex_count);
+        vertex_buffer_id_ = grow_buffer(vertex_buffer_id_, vertex_size_, capacity, new_capacity);
+        vertex_allocator_.grow(new_capacity);
+        grown = true;
+    }
+    while (!index_allocator_.allocate(index_count, out_range.first_index)) {
+        size_t capacity = index_allocator_.get_capacity();
+        size_t new_capacity = std::max(2 * capacity, capacity + index_count);
+        index_buffer_id_ = grow_buffer(index_buffer_id_, sizeof(unsigned int), capacity, new_capacity);
+        index_allocator_.grow(new_capacity);
+        grown = true;
+    }
+    if (grown) {
+        setup_vertex_array();
+    }
+    out_range.vertex_count = vertex_count;
+    out_range.index_count = index_count;
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_id_);
+    glBufferSubData(GL_ARRAY_BUFFER, out_range.first_vertex * vertex_size_, vertex_count * vertex_size_, vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, index_buffer_id_);
+    glBufferSubData(GL_ARRAY_BUFFER, out_range.first_index * sizeof(unsigned int), index_count * sizeof(unsigned int),
+                    indices);
+    return true;
+}
+
+void GeometryArena::free(const GeometryRange &range) {
+    vertex_allocator_.free(range.first_vertex, range.vertex_count);
+    index_allocator_.free(range.first_index, range.index_count);
+}
+
+GLuint GeometryArena::get_vertex_array_id() const {
+    return vertex_array_id_;
+}
+
+GeometryArenaStats GeometryArena::get_stats() const {
+    GeometryArenaStats stats;
+    stats.vertices = make_stats(vertex_allocator_);
+    stats.indices = make_stats(index_allocator_);
+    return stats;
+}
+
+GLuint GeometryArena::grow_buffer(GLuint buffer_id, size_t element_size, size_t capacity, size_t new_capacity) {
+    GLuint new_buffer_id = 0;
+    glGenBuffers(1, &new_buffer_id);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, new_buffer_id);
+    glBufferData(GL_COPY_WRITE_BUFFER, new_capacity * element_size, nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer_id);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, capacity * element_size);
+    glDeleteBuffers(1, &buffer_id);
+    return new_buffer_id;
+}
+
+void GeometryArena::setup_vertex_array() const {
+    glBindVertexArray(vertex_array_id_);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_id_);
+    set_pointers_();
+    // The index buffer binding is state of the vertex array
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_id_);
+    glBindVertexArray(0);
+}
+
+ArenaBufferStats GeometryArena::make_stats(const RangeAllocator &allocator) {
+    ArenaBufferStats stats;
+    size_t free_size = allocator.get_free_size();
+    stats.capacity = allocator.get_capacity();
+    stats.used = stats.capacity - free_size;
+    stats.free_blocks = allocator.get_free_block_count();
+    if (free_size > 0) {
+        stats.fragmentation = 1.0f - static_cast<GLfloat>(allocator.get_largest_free_block()) / free_size;
+    }
+    return stats;
+}
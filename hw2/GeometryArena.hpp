@@ -0,0 +1,114 @@
+#include <vector>
+
+#include <GL/glew.h>
+
+#ifndef HW2_GEOMETRY_ARENA
+#define HW2_GEOMETRY_ARENA
+
+// Hands out ranges of [0, capacity) : first fit in a free list sorted by
+// offset, merging neighbours on free
+class RangeAllocator {
+public:
+    void reset(size_t capacity);
+
+    // Adds [capacity, new_capacity) to the free space
+    void grow(size_t new_capacity);
+
+    // Returns false when no free block is large enough
+    bool allocate(size_t size, size_t &out_offset);
+
+    void free(size_t offset, size_t size);
+
+    size_t get_capacity() const;
+    size_t get_free_size() const;
+    size_t get_largest_free_block() const;
+    size_t get_free_block_count() const;
+
+private:
+    struct Block {
+        size_t offset;
+        size_t size;
+    };
+
+    std::vector<Block> free_blocks_;
+    size_t capacity_ = 0;
+};
+
+// Where a mesh lives in a GeometryArena. Its indices start at 0 : draws add
+// first_vertex as their base vertex.
+struct GeometryRange {
+    size_t first_vertex = 0;
+    size_t vertex_count = 0;
+    size_t first_index = 0;
+    size_t index_count = 0;
+};
+
+// Occupancy of one of the buffers. fragmentation is the part of the free
+// space outside of the largest free block.
+struct ArenaBufferStats {
+    size_t used = 0;
+    size_t capacity = 0;
+    size_t free_blocks = 0;
+    GLfloat fragmentation = 0.0f;
+};
+
+struct GeometryArenaStats {
+    ArenaBufferStats vertices;
+    ArenaBufferStats indices;
+};
+
+// One vertex buffer and one index buffer shared by every mesh of a vertex
+// layout, recorded in a single vertex array. Switching between these
+// meshes binds nothing. The buffers grow when full.
+class GeometryArena {
+public:
+    // Layout is a VertexLayout
+    template<typename Layout>
+    void init(size_t vertex_capacity, size_t index_capacity) {
+        init(sizeof(typename Layout::VertexType), &Layout::set_pointers, vertex_capacity, index_capacity);
+    }
+
+    // Must be called while the GL context is still alive
+    void release();
+
+    // Copies a mesh into the buffers. Returns false when Vertex isn't the
+    // size of the VertexType of the layout.
+    template<typename Vertex>
+    bool upload(const std::vector<Vertex> &vertices, const unsigned int *indices, size_t index_count,
+                GeometryRange &out_range) {
+        return upload(vertices.data(), sizeof(Vertex), vertices.size(), indices, index_count, out_range);
+    }
+
+    void free(const GeometryRange &range);
+
+    GLuint get_vertex_array_id() const;
+
+    GeometryArenaStats get_stats() const;
+
+private:
+    void init(size_t vertex_size, void (*set_pointers)(), size_t vertex_capacity, size_t index_capacity);
+
+    bool upload(const void *vertices, size_t vertex_size, size_t vertex_count, const unsigned int *indices,
+                size_t index_count, GeometryRange &out_range);
+
+    // Moves the contents to a buffer of new_capacity elements of
+    // element_size bytes, and returns it
+    static GLuint grow_buffer(GLuint buffer_id, size_t element_size, size_t capacity, size_t new_capacity);
+
+    // Records the buffers and the attribute pointers in the vertex array
+    void setup_vertex_array() const;
+
+    static ArenaBufferStats make_stats(const RangeAllocator &allocator);
+
+private:
+    GLuint vertex_array_id_ = 0;
+    GLuint vertex_buffer_id_ = 0;
+    GLuint index_buffer_id_ = 0;
+    size_t vertex_size_ = 0;
+    void (*set_pointers_)() = nullptr;
+
+    RangeAllocator vertex_allocator_;
+    RangeAllocator index_allocator_;
+};
+
+#endif //HW2_GEOMETRY_ARENA
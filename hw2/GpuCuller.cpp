@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <cstddef>
+
+#include "EntityStore.hpp"
+#include "GpuCuller.hpp"
+
+bool GpuCuller::is_supported() {
+    return GLEW_VERSION_4_3;
+}
+
+GpuCuller::GpuCuller(GLuint computeProgramID, const std::vector<Material> &materials) :
+        program_id_(computeProgramID) {
+    size_t command_count = 0;
+    for (size_t m = 0; m < std::min(materials.size(), kMaxMeshes); ++m) {
+        MeshSlot slot;
+        slot.material = materials[m];
+        slot.lod_count = std::min(materials[m].mesh->get_lod_count(), kMaxLods);
+        slot.first_command = command_count;
+        command_count += slot.lod_count;
+        meshes_.push_back(slot);
+    }
+}
+
+void GpuCuller::release() {
+    if (command_buffer_id_ == 0) {
+        return;
+    }
+    glDeleteBuffers(1, &instance_buffer_id_);
+    glDeleteBuffers(1, &visible_buffer_id_);
+    glDeleteBuffers(1, &command_buffer_id_);
+    glDeleteBuffers(1, &pyramid_buffer_id_);
+    instance_buffer_id_ = 0;
+    visible_buffer_id_ = 0;
+    command_buffer_id_ = 0;
+    pyramid_buffer_id_ = 0;
+    lod_capacity_ = 0;
+}
+
+void GpuCuller::set_instances(size_t mesh, JobSystem &jobs, size_t count,
+                              const std::function<InstanceData(size_t)> &get_instance) {
+    std::vector<InstanceData> &instances = meshes_[mesh].instances;
+    instances.resize(count);
+    jobs.parallelFor(0, count, EntityStore::kJobGrainSize, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            instances[i] = get_instance(i);
+        }
+    });
+}
+
+void GpuCuller::cull(const Frustum &frustum, const LodView &view, const OcclusionCuller *occlusion,
+                     GLStateTracker &state) {
+    if (command_buffer_id_ == 0) {
+        create_buffers();
+    }
+
+    // Every command's region must be able to hold every instance of its mesh
+    size_t instance_count = 0;
+    size_t largest = 0;
+    for (const MeshSlot &slot : meshes_) {
+        instance_count += slot.instances.size();
+        largest = std::max(largest, slot.instances.size());
+    }
+    if (largest > lod_capacity_) {
+        lod_capacity_ = largest + largest / 2;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, visible_buffer_id_);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, commands_.size() * lod_capacity_ * sizeof(VisibleInstance), nullptr,
+                     GL_DYNAMIC_COPY);
+    }
+
+    // The instances of every mesh one after the other
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance_buffer_id_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, instance_count * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+    size_t first_instance = 0;
+    for (const MeshSlot &slot : meshes_) {
+        if (!slot.instances.empty()) {
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, first_instance * sizeof(InstanceData),
+                            slot.instances.size() * sizeof(InstanceData), slot.instances.data());
+        }
+        first_instance += slot.instances.size();
+    }
+
+    // The shader counts the instances of each LOD from 0
+    for (const MeshSlot &slot : meshes_) {
+        const Mesh &mesh = *slot.material.mesh;
+        for (size_t lod = 0; lod < slot.lod_count; ++lod) {
+            size_t index = slot.first_command + lod;
+            DrawCommand &command = commands_[index];
+            command.count = static_cast<GLuint>(mesh.get_lod_index_count(lod));
+            command.instance_count = 0;
+            command.first_index = static_cast<GLuint>(mesh.get_lod_first_index(lod));
+            command.base_vertex = mesh.get_base_vertex();
+            command.base_instance = static_cast<GLuint>(index * lod_capacity_);
+        }
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, command_buffer_id_);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, commands_.size() * sizeof(DrawCommand), commands_.data());
+
+    state.use_program(program_id_);
+    glUniform4fv(frustum_planes_location_, 6, &frustum.planes[0][0]);
+    glUniform3fv(camera_position_location_, 1, &view.camera_position[0]);
+    glUniform1f(pixels_per_unit_location_, view.pixels_per_unit);
+    glUniform1f(lod_pixel_error_location_, Mesh::kLodPixelError);
+    glUniform1ui(lod_capacity_location_, static_cast<GLuint>(lod_capacity_));
+    if (occlusion != nullptr) {
+        upload_pyramid(*occlusion);
+    } else {
+        glUniform1ui(pyramid_levels_location_, 0);
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kInstancesBinding, instance_buffer_id_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kVisibleBinding, visible_buffer_id_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kCommandsBinding, command_buffer_id_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kPyramidBinding, pyramid_buffer_id_);
+    first_instance = 0;
+    for (size_t m = 0; m < meshes_.size(); ++m) {
+        const MeshSlot &slot = meshes_[m];
+        const Mesh &mesh = *slot.material.mesh;
+        GLuint group_count = static_cast<GLuint>((slot.instances.size() + kWorkGroupSize - 1) / kWorkGroupSize);
+        if (group_count > 0) {
+            GLfloat lod_errors[kMaxLods] = {};
+            for (size_t lod = 0; lod < slot.lod_count; ++lod) {
+                lod_errors[lod] = mesh.get_lod_error(lod);
+            }
+            glUniform1ui(instance_count_location_, static_cast<GLuint>(slot.instances.size()));
+            glUniform1ui(first_instance_location_, static_cast<GLuint>(first_instance));
+            glUniform1ui(first_command_location_, static_cast<GLuint>(slot.first_command));
+            glUniform1f(mesh_index_location_, static_cast<GLfloat>(m));
+            glUniform1f(bounding_radius_location_, mesh.get_bounding_radius());
+            glUniform1ui(lod_count_location_, static_cast<GLuint>(slot.lod_count));
+            glUniform1fv(lod_errors_location_, kMaxLods, lod_errors);
+            glDispatchCompute(group_count, 1, 1);
+        }
+        first_instance += slot.instances.size();
+    }
+
+    // The draw reads the commands and the instances the shader wrote
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void GpuCuller::draw(const glm::mat4 &MVP, GLStateTracker &state) const {
+    if (command_buffer_id_ == 0 || meshes_.empty()) {
+        return;
+    }
+
+    // The instanced shaders index these uniforms and texture units with the
+    // mesh index of each instance. InstanceBatch only uses element 0 and
+    // unit 0 : its mesh uniforms have to be uploaded again after this.
+    const Material &material = meshes_[0].material;
+    state.use_program(material.program_id);
+    if (state.need_frame_uniforms(material.program_id)) {
+        glUniformMatrix4fv(material.matrix_location, 1, GL_FALSE, &MVP[0][0]);
+    }
+    glm::vec3 position_offsets[kMaxMeshes];
+    glm::vec3 position_scales[kMaxMeshes];
+    for (size_t m = 0; m < meshes_.size(); ++m) {
+        position_offsets[m] = meshes_[m].material.mesh->get_position_offset();
+        position_scales[m] = meshes_[m].material.mesh->get_position_scale();
+        state.bind_texture(static_cast<GLuint>(m), meshes_[m].material.texture_id);
+    }
+    GLsizei mesh_count = static_cast<GLsizei>(meshes_.size());
+    glUniform3fv(material.position_offset_location, mesh_count, &position_offsets[0][0]);
+    glUniform3fv(material.position_scale_location, mesh_count, &position_scales[0][0]);
+    state.forget_mesh_uniforms(material.program_id);
+    state.bind_vertex_array(material.mesh->get_vertex_array_id());
+
+    // The base instance of each command points at its region of the buffer
+    glBindBuffer(GL_ARRAY_BUFFER, visible_buffer_id_);
+    InstanceBatch::enable_instance_attributes();
+    InstanceBatch::point_instance_attributes(0, sizeof(VisibleInstance));
+    glEnableVertexAttribArray(kMeshIndexLocation);
+    glVertexAttribDivisor(kMeshIndexLocation, 1);
+    glVertexAttribPointer(kMeshIndexLocation, 1, GL_FLOAT, GL_FALSE, sizeof(VisibleInstance),
+                          reinterpret_cast<void *>(offsetof(VisibleInstance, mesh_index)));
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer_id_);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(commands_.size()), 0);
+
+    InstanceBatch::disable_instance_attributes();
+    glVertexAttribDivisor(kMeshIndexLocation, 0);
+    glDisableVertexAttribArray(kMeshIndexLocation);
+}
+
+void GpuCuller::read_visible(size_t mesh, std::vector<InstanceData> &out_instances,
+                             std::vector<size_t> &out_lods) const {
+    out_instances.clear();
+    out_lods.clear();
+    if (command_buffer_id_ == 0) {
+        return;
+    }
+
+    const MeshSlot &slot = meshes_[mesh];
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    std::vector<DrawCommand> commands(slot.lod_count);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, command_buffer_id_);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, slot.first_command * sizeof(DrawCommand),
+                       commands.size() * sizeof(DrawCommand), commands.data());
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, visible_buffer_id_);
+    std::vector<VisibleInstance> visible;
+    for (size_t lod = 0; lod < slot.lod_count; ++lod) {
+        visible.resize(commands[lod].instance_count);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                           (slot.first_command + lod) * lod_capacity_ * sizeof(VisibleInstance),
+                           visible.size() * sizeof(VisibleInstance), visible.data());
+        for (const VisibleInstance &instance : visible) {
+            out_instances.push_back(instance.instance);
+            out_lods.push_back(lod);
+        }
+    }
+}
+
+void GpuCuller::create_buffers() {
+    instance_count_location_ = glGetUniformLocation(program_id_, "instance_count");
+    first_instance_location_ = glGetUniformLocation(program_id_, "first_instance");
+    first_command_location_ = glGetUniformLocation(program_id_, "first_command");
+    mesh_index_location_ = glGetUniformLocation(program_id_, "mesh_index");
+    frustum_planes_location_ = glGetUniformLocation(program_id_, "frustum_planes");
+    bounding_radius_location_ = glGetUniformLocation(program_id_, "bounding_radius");
+    camera_position_location_ = glGetUniformLocation(program_id_, "camera_position");
+    pixels_per_unit_location_ = glGetUniformLocation(program_id_, "pixels_per_unit");
+    lod_pixel_error_location_ = glGetUniformLocation(program_id_, "lod_pixel_error");
+    lod_count_location_ = glGetUniformLocation(program_id_, "lod_count");
+    lod_errors_location_ = glGetUniformLocation(program_id_, "lod_errors");
+    lod_capacity_location_ = glGetUniformLocation(program_id_, "lod_capacity");
+    pyramid_levels_location_ = glGetUniformLocation(program_id_, "pyramid_levels");
+    pyramid_offsets_location_ = glGetUniformLocation(program_id_, "pyramid_offsets");
+    pyramid_sizes_location_ = glGetUniformLocation(program_id_, "pyramid_sizes");
+    occlusion_view_location_ = glGetUniformLocation(program_id_, "occlusion_view");
+    occlusion_scale_location_ = glGetUniformLocation(program_id_, "occlusion_scale");
+    occlusion_near_plane_location_ = glGetUniformLocation(program_id_, "occlusion_near_plane");
+
+    glGenBuffers(1, &instance_buffer_id_);
+    glGenBuffers(1, &visible_buffer_id_);
+    glGenBuffers(1, &command_buffer_id_);
+    // Bound even without occlusion : every buffer the shader declares must be
+    glGenBuffers(1, &pyramid_buffer_id_);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, pyramid_buffer_id_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLfloat), nullptr, GL_STREAM_DRAW);
+    size_t command_count = 0;
+    for (const MeshSlot &slot : meshes_) {
+        command_count += slot.lod_count;
+    }
+    commands_.resize(command_count);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, command_buffer_id_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, commands_.size() * sizeof(DrawCommand), nullptr, GL_DYNAMIC_DRAW);
+}
+
+void GpuCuller::upload_pyramid(const OcclusionCuller &occlusion) {
+    const DepthBuffer &buffer = occlusion.get_depth_buffer();
+    size_t level_count = std::min(buffer.levels.size(), kMaxPyramidLevels);
+    GLuint offsets[kMaxPyramidLevels] = {};
+    GLint sizes[2 * kMaxPyramidLevels] = {};
+    pyramid_.clear();
+    for (size_t level = 0; level < level_count; ++level) {
+        offsets[level] = static_cast<GLuint>(pyramid_.size());
+        sizes[2 * level] = buffer.levelWidths[level];
+        sizes[2 * level + 1] = buffer.levelHeights[level];
+        pyramid_.insert(pyramid_.end(), buffer.levels[level].begin(), buffer.levels[level].end());
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, pyramid_buffer_id_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, pyramid_.size() * sizeof(GLfloat), pyramid_.data(), GL_STREAM_DRAW);
+
+    const glm::mat4 &projection = occlusion.get_projection();
+    glm::vec2 scale(projection[0][0], projection[1][1]);
+    glUniform1ui(pyramid_levels_location_, static_cast<GLuint>(level_count));
+    glUniform1uiv(pyramid_offsets_location_, kMaxPyramidLevels, offsets);
+    glUniform2iv(pyramid_sizes_location_, kMaxPyramidLevels, sizes);
+    glUniformMatrix4fv(occlusion_view_location_, 1, GL_FALSE, &occlusion.get_view()[0][0]);
+    glUniform2fv(occlusion_scale_location_, 1, &scale[0]);
+    glUniform1f(occlusion_near_plane_location_, OcclusionCuller::kNearPlane);
+}
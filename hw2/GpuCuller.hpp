@@ -0,0 +1,144 @@
+#include <functional>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <common/jobsystem.hpp>
+
+#include "Mesh.hpp"
+#include "LooseOctree.hpp"
+#include "GLStateTracker.hpp"
+#include "RenderQueue.hpp"
+#include "InstanceBatch.hpp"
+#include "OcclusionCuller.hpp"
+
+#ifndef HW2_GPU_CULLER
+#define HW2_GPU_CULLER
+
+// Frustum culling, occlusion culling against OcclusionCuller's depth pyramid
+// and LOD selection of the instances of several meshes in a compute shader
+// (shaders/CullComputeShader.glsl). The survivors and the
+// draw commands stay on the GPU : every mesh is drawn by one
+// glMultiDrawElementsIndirect, with one command per LOD of each mesh. Each
+// visible instance carries the index of its mesh, which picks its
+// dequantization uniforms and its texture unit in the instanced shaders.
+// LooseOctree, OcclusionCuller::cull and Mesh::select_lod are the CPU
+// version of the same tests.
+class GpuCuller {
+public:
+    // Compute shaders, SSBOs and base instances : GL 4.3. Mesa's llvmpipe
+    // has them.
+    static bool is_supported();
+
+    // One material per mesh, at most kMaxMeshes. They must share their
+    // program, built from the instanced shaders, and the arena's vertex
+    // array. No GL call until the first cull, so that one can be made
+    // whether or not it's supported.
+    GpuCuller(GLuint computeProgramID, const std::vector<Material> &materials);
+
+    // Must be called while the GL context is still alive
+    void release();
+
+    // Replaces the instances of the mesh of materials[mesh] with
+    // get_instance(0) .. get_instance(count - 1), computed on all the threads
+    void set_instances(size_t mesh, JobSystem &jobs, size_t count,
+                       const std::function<InstanceData(size_t)> &get_instance);
+
+    // Uploads the instances of every mesh and dispatches the culling, once
+    // per mesh. With occlusion, its last render_occluders is uploaded too,
+    // and what hides behind it is dropped. The compute program goes through
+    // state.
+    void cull(const Frustum &frustum, const LodView &view, const OcclusionCuller *occlusion, GLStateTracker &state);
+
+    // Draws what the last cull kept, every mesh in one call. The program,
+    // textures and vertex array go through state.
+    void draw(const glm::mat4 &MVP, GLStateTracker &state) const;
+
+    // What the last cull kept of a mesh, read back from the GPU. Slow : to
+    // compare with the CPU path only.
+    void read_visible(size_t mesh, std::vector<InstanceData> &out_instances, std::vector<size_t> &out_lods) const;
+
+    // Size of the per-mesh arrays of the instanced shaders
+    constexpr static size_t kMaxMeshes = 2;
+
+private:
+    // Same layout as DrawElementsIndirectCommand
+    struct DrawCommand {
+        GLuint count;
+        GLuint instance_count;
+        GLuint first_index;
+        GLint base_vertex;
+        GLuint base_instance;
+    };
+
+    // What the shader writes for each instance it keeps
+    struct VisibleInstance {
+        InstanceData instance;
+        GLfloat mesh_index;
+    };
+
+    struct MeshSlot {
+        Material material;
+        size_t lod_count;
+        // Of its LOD 0 in the command buffer
+        size_t first_command;
+        std::vector<InstanceData> instances;
+    };
+
+    void create_buffers();
+    // Every level of the pyramid one after the other, and where they start
+    void upload_pyramid(const OcclusionCuller &occlusion);
+
+private:
+    GLuint program_id_ = 0;
+    std::vector<MeshSlot> meshes_;
+
+    GLint instance_count_location_ = -1;
+    GLint first_instance_location_ = -1;
+    GLint first_command_location_ = -1;
+    GLint mesh_index_location_ = -1;
+    GLint frustum_planes_location_ = -1;
+    GLint bounding_radius_location_ = -1;
+    GLint camera_position_location_ = -1;
+    GLint pixels_per_unit_location_ = -1;
+    GLint lod_pixel_error_location_ = -1;
+    GLint lod_count_location_ = -1;
+    GLint lod_errors_location_ = -1;
+    GLint lod_capacity_location_ = -1;
+    GLint pyramid_levels_location_ = -1;
+    GLint pyramid_offsets_location_ = -1;
+    GLint pyramid_sizes_location_ = -1;
+    GLint occlusion_view_location_ = -1;
+    GLint occlusion_scale_location_ = -1;
+    GLint occlusion_near_plane_location_ = -1;
+
+    GLuint instance_buffer_id_ = 0;
+    GLuint visible_buffer_id_ = 0;
+    GLuint command_buffer_id_ = 0;
+    GLuint pyramid_buffer_id_ = 0;
+    // Instances per command region of the visible buffer
+    size_t lod_capacity_ = 0;
+    std::vector<DrawCommand> commands_;
+    std::vector<GLfloat> pyramid_;
+
+private:
+    // Binding points of the shader's buffers
+    constexpr static GLuint kInstancesBinding = 0;
+    constexpr static GLuint kVisibleBinding = 1;
+    constexpr static GLuint kCommandsBinding = 2;
+    constexpr static GLuint kPyramidBinding = 3;
+
+    // Attribute location of the mesh index in the instanced vertex shader
+    constexpr static GLuint kMeshIndexLocation = 5;
+
+    constexpr static GLuint kWorkGroupSize = 64;
+    // Size of lod_errors in the shader
+    constexpr static size_t kMaxLods = 6;
+    // Size of the pyramid arrays in the shader : enough for a 2048 wide
+    // depth buffer. Past it, the largest objects are tested against a finer
+    // level than on the CPU, which reads more texels.
+    constexpr static size_t kMaxPyramidLevels = 12;
+};
+
+#endif //HW2_GPU_CULLER
@@ -0,0 +1,137 @@
+#include <cmath>
+#include <cstddef>
+
+#include "EntityStore.hpp"
+#include "InstanceBatch.hpp"
+
+// The shader reads position and spin_angle as one vec4
+static_assert(offsetof(InstanceData, spin_angle) == offsetof(InstanceData, position) + sizeof(glm::vec3),
+              "InstanceData must keep spin_angle right after position");
+
+InstanceBatch::InstanceBatch(GLuint programID, const Mesh &mesh, GLuint textureID) :
+        material_(make_material(programID, mesh, textureID)),
+        lod_instances_(mesh.get_lod_count()) {
+    glGenBuffers(1, &instance_buffer_id_);
+}
+
+void InstanceBatch::release() {
+    glDeleteBuffers(1, &instance_buffer_id_);
+    instance_buffer_id_ = 0;
+    instance_capacity_ = 0;
+}
+
+void InstanceBatch::set_instances(JobSystem &jobs, size_t count,
+                                  const std::function<InstanceData(size_t)> &get_instance, const LodView &view) {
+    staged_instances_.resize(count);
+    staged_lods_.resize(count);
+    jobs.parallelFor(0, count, EntityStore::kJobGrainSize, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            staged_instances_[i] = get_instance(i);
+            staged_lods_[i] = static_cast<unsigned char>(
+                    material_.mesh->select_lod(staged_instances_[i].position, staged_instances_[i].scale, view));
+        }
+    });
+
+    // Only copies left : not worth the threads
+    for (std::vector<InstanceData> &instances : lod_instances_) {
+        instances.clear();
+    }
+    for (size_t i = 0; i < count; ++i) {
+        lod_instances_[staged_lods_[i]].push_back(staged_instances_[i]);
+    }
+    camera_position_ = view.camera_position;
+}
+
+bool InstanceBatch::empty() const {
+    for (const std::vector<InstanceData> &instances : lod_instances_) {
+        if (!instances.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const Material &InstanceBatch::get_material() const {
+    return material_;
+}
+
+void InstanceBatch::draw_instances() {
+    size_t instance_count = 0;
+    for (const std::vector<InstanceData> &instances : lod_instances_) {
+        instance_count += instances.size();
+    }
+    if (instance_count == 0) {
+        return;
+    }
+
+    // Upload the instances of every LOD one after the other. Orphan the old
+    // storage, so that the driver doesn't wait for last frame's draws.
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_id_);
+    if (instance_count > instance_capacity_) {
+        instance_capacity_ = instance_count + instance_count / 2;
+    }
+    glBufferData(GL_ARRAY_BUFFER, instance_capacity_ * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+    size_t first_instance = 0;
+    for (const std::vector<InstanceData> &instances : lod_instances_) {
+        if (!instances.empty()) {
+            glBufferSubData(GL_ARRAY_BUFFER, first_instance * sizeof(InstanceData),
+                            instances.size() * sizeof(InstanceData), instances.data());
+            first_instance += instances.size();
+        }
+    }
+
+    // GL 3.3 has no base instance : point the attributes at each LOD's
+    // range of the buffer instead
+    enable_instance_attributes();
+    first_instance = 0;
+    for (size_t lod = 0; lod < lod_instances_.size(); ++lod) {
+        std::vector<InstanceData> &instances = lod_instances_[lod];
+        if (instances.empty()) {
+            continue;
+        }
+        // The camera in the model space of each instance : the inverse of
+        // the shader's scale, rotation around Z and translation
+        cameras_modelspace_.clear();
+        if (lod == 0) {
+            for (const InstanceData &instance : instances) {
+                glm::vec3 d = camera_position_ - instance.position;
+                GLfloat c = std::cos(instance.spin_angle);
+                GLfloat s = std::sin(instance.spin_angle);
+                cameras_modelspace_.push_back(glm::vec3(c * d.x + s * d.y, c * d.y - s * d.x, d.z) / instance.scale);
+            }
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_id_);
+        point_instance_attributes(first_instance);
+        material_.mesh->draw_instanced(lod, static_cast<GLsizei>(instances.size()), cameras_modelspace_);
+
+        first_instance += instances.size();
+        instances.clear();
+    }
+    disable_instance_attributes();
+}
+
+void InstanceBatch::enable_instance_attributes() {
+    // Per-instance attributes, advancing once per instance, added to the
+    // vertex array of the mesh for the duration of the draw
+    glEnableVertexAttribArray(kPositionSpinLocation);
+    glEnableVertexAttribArray(kScaleLocation);
+    glVertexAttribDivisor(kPositionSpinLocation, 1);
+    glVertexAttribDivisor(kScaleLocation, 1);
+}
+
+void InstanceBatch::point_instance_attributes(size_t first_instance, GLsizei stride) {
+    size_t base = first_instance * stride;
+    glVertexAttribPointer(kPositionSpinLocation, 4, GL_FLOAT, GL_FALSE, stride,
+                          reinterpret_cast<void *>(base + offsetof(InstanceData, position)));
+    glVertexAttribPointer(kScaleLocation, 1, GL_FLOAT, GL_FALSE, stride,
+                          reinterpret_cast<void *>(base + offsetof(InstanceData, scale)));
+}
+
+void InstanceBatch::disable_instance_attributes() {
+    // Leave the vertex array the way the per-object draws expect it
+    glVertexAttribDivisor(kPositionSpinLocation, 0);
+    glVertexAttribDivisor(kScaleLocation, 0);
+    glDisableVertexAttribArray(kPositionSpinLocation);
+    glDisableVertexAttribArray(kScaleLocation);
+}
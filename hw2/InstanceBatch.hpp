@@ -0,0 +1,78 @@
+#include <functional>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <common/jobsystem.hpp>
+
+#include "Mesh.hpp"
+#include "RenderQueue.hpp"
+#include "LooseOctree.hpp"
+
+#ifndef HW2_INSTANCE_BATCH
+#define HW2_INSTANCE_BATCH
+
+// What the instanced vertex shader needs to place one copy of a mesh
+struct InstanceData {
+    glm::vec3 position;
+    GLfloat spin_angle; // around Z
+    GLfloat scale;
+};
+
+// Collects the instances of one mesh during a frame, then uploads them in a
+// single buffer and draws them with one glDrawElementsInstanced per LOD.
+// The program must be built from shaders/InstancedVertexShader.glsl. The
+// batch is drawn through a RenderQueue, which sets up its material.
+class InstanceBatch {
+public:
+    InstanceBatch(GLuint programID, const Mesh &mesh, GLuint textureID);
+
+    // Must be called while the GL context is still alive
+    void release();
+
+    // Replaces the instances with get_instance(0) .. get_instance(count - 1),
+    // computed on all the threads. The LOD of each instance is picked from
+    // its distance to the camera.
+    void set_instances(JobSystem &jobs, size_t count, const std::function<InstanceData(size_t)> &get_instance,
+                       const LodView &view);
+
+    bool empty() const;
+
+    const Material &get_material() const;
+
+    // Draws everything added since the last call, and forgets it. The
+    // program, texture, uniforms and the mesh vertex array must be bound already.
+    void draw_instances();
+
+    // The per-instance attributes, also used by GpuCuller's draw
+    static void enable_instance_attributes();
+    // At the buffer bound to GL_ARRAY_BUFFER, which holds one InstanceData
+    // at the start of every stride bytes
+    static void point_instance_attributes(size_t first_instance, GLsizei stride = sizeof(InstanceData));
+    static void disable_instance_attributes();
+
+private:
+    Material material_;
+    GLuint instance_buffer_id_ = 0;
+    // Size of the buffer's storage, in instances
+    size_t instance_capacity_ = 0;
+
+    // Instances of the frame, one list per LOD
+    std::vector<std::vector<InstanceData>> lod_instances_;
+
+    // Filled by the threads, before sorting by LOD
+    std::vector<InstanceData> staged_instances_;
+    std::vector<unsigned char> staged_lods_;
+
+    // Of the last set_instances, for the meshlet culling of the full LOD
+    glm::vec3 camera_position_ = glm::vec3(0.0f);
+    std::vector<glm::vec3> cameras_modelspace_;
+
+private:
+    // Attribute locations of the instanced vertex shader
+    constexpr static GLuint kPositionSpinLocation = 3;
+    constexpr static GLuint kScaleLocation = 4;
+};
+
+#endif //HW2_INSTANCE_BATCH
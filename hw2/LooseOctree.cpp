@@ -0,0 +1,221 @@
+#include <cmath>
+
+#include "LooseOctree.hpp"
+
+Frustum extract_frustum(const glm::mat4 &view_projection) {
+    const glm::mat4 &m = view_projection;
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; ++i) {
+        row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    }
+
+    // Left, right, bottom, top, near, far
+    Frustum frustum;
+    frustum.planes[0] = row[3] + row[0];
+    frustum.planes[1] = row[3] - row[0];
+    frustum.planes[2] = row[3] + row[1];
+    frustum.planes[3] = row[3] - row[1];
+    frustum.planes[4] = row[3] + row[2];
+    frustum.planes[5] = row[3] - row[2];
+    for (glm::vec4 &plane : frustum.planes) {
+        plane = plane * (1 / glm::length(glm::vec3(plane.x, plane.y, plane.z)));
+    }
+    return frustum;
+}
+
+static GLfloat plane_distance(const glm::vec4 &plane, const glm::vec3 &point) {
+    return plane.x * point.x + plane.y * point.y + plane.z * point.z + plane.w;
+}
+
+LooseOctree::LooseOctree(GLfloat world_half_size, unsigned int max_depth) :
+        world_half_size_(world_half_size),
+        max_depth_(max_depth) {
+    Node root;
+    root.center = glm::vec3(0.0f);
+    root.half_size = world_half_size;
+    root.depth = 0;
+    root.parent = -1;
+    for (GLint &child : root.children) {
+        child = -1;
+    }
+    root.subtree_count = 0;
+    nodes_.push_back(root);
+}
+
+unsigned int LooseOctree::depth_for(const BoundingSphere &sphere) const {
+    const glm::vec3 &c = sphere.center;
+    if (std::abs(c.x) >= world_half_size_ || std::abs(c.y) >= world_half_size_ || std::abs(c.z) >= world_half_size_) {
+        return 0;
+    }
+    // Deepest level whose cells are at least as large as the sphere
+    unsigned int depth = 0;
+    GLfloat half_size = world_half_size_;
+    while (depth < max_depth_ && sphere.radius <= half_size / 2) {
+        half_size /= 2;
+        ++depth;
+    }
+    return depth;
+}
+
+bool LooseOctree::holds(const Node &node, const BoundingSphere &sphere) const {
+    if (node.depth != depth_for(sphere)) {
+        return false;
+    }
+    if (node.depth == 0) {
+        return true;
+    }
+    glm::vec3 d = sphere.center - node.center;
+    return std::abs(d.x) <= node.half_size && std::abs(d.y) <= node.half_size && std::abs(d.z) <= node.half_size;
+}
+
+GLint LooseOctree::find_node(const BoundingSphere &sphere) {
+    unsigned int depth = depth_for(sphere);
+    GLint node = 0;
+    while (nodes_[node].depth < depth) {
+        const glm::vec3 center = nodes_[node].center;
+        int child = (sphere.center.x >= center.x ? 1 : 0) |
+                    (sphere.center.y >= center.y ? 2 : 0) |
+                    (sphere.center.z >= center.z ? 4 : 0);
+        if (nodes_[node].children[child] < 0) {
+            Node created;
+            created.half_size = nodes_[node].half_size / 2;
+            created.center = center + glm::vec3(child & 1 ? created.half_size : -created.half_size,
+                                                child & 2 ? created.half_size : -created.half_size,
+                                                child & 4 ? created.half_size : -created.half_size);
+            created.depth = nodes_[node].depth + 1;
+            created.parent = node;
+            for (GLint &grandchild : created.children) {
+                grandchild = -1;
+            }
+            created.subtree_count = 0;
+            nodes_[node].children[child] = static_cast<GLint>(nodes_.size());
+            nodes_.push_back(created);
+        }
+        node = nodes_[node].children[child];
+    }
+    return node;
+}
+
+void LooseOctree::link(uint32_t slot, GLint node) {
+    Record &record = records_[slot];
+    record.node = node;
+    record.index_in_node = static_cast<uint32_t>(nodes_[node].slots.size());
+    nodes_[node].slots.push_back(slot);
+    for (GLint n = node; n >= 0; n = nodes_[n].parent) {
+        ++nodes_[n].subtree_count;
+    }
+}
+
+void LooseOctree::unlink(uint32_t slot) {
+    Record &record = records_[slot];
+    std::vector<uint32_t> &slots = nodes_[record.node].slots;
+    slots[record.index_in_node] = slots.back();
+    records_[slots[record.index_in_node]].index_in_node = record.index_in_node;
+    slots.pop_back();
+    for (GLint n = record.node; n >= 0; n = nodes_[n].parent) {
+        --nodes_[n].subtree_count;
+    }
+    record.node = -1;
+}
+
+void LooseOctree::sync(const EntityStore &store, const std::function<BoundingSphere(size_t)> &get_sphere) {
+    for (size_t i = 0; i < store.size(); ++i) {
+        EntityHandle handle = store.handle_at(i);
+        if (records_.size() <= handle.slot) {
+            records_.resize(handle.slot + 1);
+        }
+        Record &record = records_[handle.slot];
+        // A record of a dead entity whose slot got reused is simply taken over
+        record.handle = handle;
+        record.sphere = get_sphere(i);
+        if (record.node < 0) {
+            record.index_in_tracked = static_cast<uint32_t>(tracked_.size());
+            tracked_.push_back(handle.slot);
+            link(handle.slot, find_node(record.sphere));
+        } else if (!holds(nodes_[record.node], record.sphere)) {
+            unlink(handle.slot);
+            link(handle.slot, find_node(record.sphere));
+        }
+    }
+
+    // Backwards, so that the slot swapped in has already been looked at
+    for (size_t k = tracked_.size(); k-- > 0;) {
+        uint32_t slot = tracked_[k];
+        if (store.is_alive(records_[slot].handle)) {
+            continue;
+        }
+        unlink(slot);
+        tracked_[k] = tracked_.back();
+        records_[tracked_[k]].index_in_tracked = static_cast<uint32_t>(k);
+        tracked_.pop_back();
+    }
+}
+
+void LooseOctree::query(const Frustum &frustum, const EntityStore &store, std::vector<size_t> &out_indices) {
+    out_indices.clear();
+    stats_ = CullStats();
+    query_node(0, frustum, store, out_indices);
+    stats_.visible_objects = out_indices.size();
+    stats_.culled_objects = tracked_.size() - out_indices.size();
+}
+
+void LooseOctree::collect(GLint node, const EntityStore &store, std::vector<size_t> &out_indices) {
+    const Node &n = nodes_[node];
+    ++stats_.visited_nodes;
+    for (uint32_t slot : n.slots) {
+        out_indices.push_back(store.index_of(records_[slot].handle));
+    }
+    for (GLint child : n.children) {
+        if (child >= 0 && nodes_[child].subtree_count != 0) {
+            collect(child, store, out_indices);
+        }
+    }
+}
+
+void LooseOctree::query_node(GLint node, const Frustum &frustum, const EntityStore &store,
+                             std::vector<size_t> &out_indices) {
+    const Node &n = nodes_[node];
+    ++stats_.visited_nodes;
+
+    // The root also holds what is outside the world : never skip it
+    if (node != 0) {
+        GLfloat loose_half_size = 2 * n.half_size;
+        bool all_inside = true;
+        for (const glm::vec4 &plane : frustum.planes) {
+            GLfloat extent = loose_half_size * (std::abs(plane.x) + std::abs(plane.y) + std::abs(plane.z));
+            GLfloat distance = plane_distance(plane, n.center);
+            if (distance < -extent) {
+                return;
+            }
+            all_inside = all_inside && distance >= extent;
+        }
+        if (all_inside) {
+            --stats_.visited_nodes; // collect counts it
+            collect(node, store, out_indices);
+            return;
+        }
+    }
+
+    for (uint32_t slot : n.slots) {
+        const BoundingSphere &sphere = records_[slot].sphere;
+        bool visible = true;
+        for (const glm::vec4 &plane : frustum.planes) {
+            if (plane_distance(plane, sphere.center) < -sphere.radius) {
+                visible = false;
+                break;
+            }
+        }
+        if (visible) {
+            out_indices.push_back(store.index_of(records_[slot].handle));
+        }
+    }
+    for (GLint child : n.children) {
+        if (child >= 0 && nodes_[child].subtree_count != 0) {
+            query_node(child, frustum, store, out_indices);
+        }
+    }
+}
+
+const CullStats &LooseOctree::get_stats() const {
+    return stats_;
+}
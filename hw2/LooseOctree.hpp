@@ -0,0 +1,103 @@
+#include <functional>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "EntityStore.hpp"
+
+#ifndef HW2_LOOSE_OCTREE
+#define HW2_LOOSE_OCTREE
+
+struct BoundingSphere {
+    glm::vec3 center;
+    GLfloat radius;
+};
+
+// Planes facing inwards, normalized : a point p is inside a plane when
+// dot(plane.xyz, p) + plane.w >= 0
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+// From the rows of projection * view (Gribb & Hartmann)
+Frustum extract_frustum(const glm::mat4 &view_projection);
+
+// What the last query did
+struct CullStats {
+    size_t visited_nodes = 0;
+    size_t culled_objects = 0;
+    size_t visible_objects = 0;
+};
+
+// Loose octree over the bounding spheres of the entities of an EntityStore.
+// Each node's bounds are twice its cell, so an entity lives in the deepest
+// node whose cell holds its center and is at least as large as its
+// diameter, and never straddles nodes. An entity that moves only changes
+// node when it leaves its cell.
+class LooseOctree {
+public:
+    // The cells cover the cube of half size world_half_size around the
+    // origin. Entities outside of it stay in the root.
+    explicit LooseOctree(GLfloat world_half_size, unsigned int max_depth = kDefaultMaxDepth);
+
+    // Inserts the new entities of the store, moves the others to their
+    // current sphere, and removes the ones that are gone
+    void sync(const EntityStore &store, const std::function<BoundingSphere(size_t)> &get_sphere);
+
+    // Indices in store of the entities whose sphere touches the frustum.
+    // Subtrees whole outside (or whole inside) aren't looked into.
+    void query(const Frustum &frustum, const EntityStore &store, std::vector<size_t> &out_indices);
+
+    const CullStats &get_stats() const;
+
+private:
+    struct Node {
+        glm::vec3 center;
+        GLfloat half_size; // of the cell; the loose bounds are twice that
+        unsigned int depth;
+        GLint parent;
+        GLint children[8];
+        std::vector<uint32_t> slots; // of the entities in this node
+        size_t subtree_count;        // entities in this node and below
+    };
+
+    struct Record {
+        EntityHandle handle;
+        BoundingSphere sphere;
+        GLint node = -1;
+        uint32_t index_in_node = 0;
+        uint32_t index_in_tracked = 0;
+    };
+
+    // The deepest node for the sphere, created along the way
+    GLint find_node(const BoundingSphere &sphere);
+
+    unsigned int depth_for(const BoundingSphere &sphere) const;
+
+    bool holds(const Node &node, const BoundingSphere &sphere) const;
+
+    void link(uint32_t slot, GLint node);
+
+    void unlink(uint32_t slot);
+
+    void query_node(GLint node, const Frustum &frustum, const EntityStore &store, std::vector<size_t> &out_indices);
+
+    // Everything below node, without testing
+    void collect(GLint node, const EntityStore &store, std::vector<size_t> &out_indices);
+
+private:
+    GLfloat world_half_size_;
+    unsigned int max_depth_;
+    std::vector<Node> nodes_;
+    // Indexed by handle slot
+    std::vector<Record> records_;
+    // Slots with a record in the tree
+    std::vector<uint32_t> tracked_;
+    CullStats stats_;
+
+private:
+    constexpr static unsigned int kDefaultMaxDepth = 6;
+};
+
+#endif //HW2_LOOSE_OCTREE
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <common/meshcache.hpp>
+#include <common/vboquantizer.hpp>
+
+#include "Mesh.hpp"
+#include "VertexLayout.hpp"
+
+// Ids of the meshes loaded so far
+static unsigned int loaded_mesh_count = 0;
+
+bool Mesh::load(const char *obj_path, GeometryArena &arena, bool quantize) {
+    MeshBin mesh;
+    if (!loadMeshBin(obj_path, mesh)) {
+        return false;
+    }
+    id_ = ++loaded_mesh_count;
+    vertex_count_ = mesh.vertexCount;
+    index_count_ = mesh.lods[0].indexCount;
+    quantized_ = quantize;
+    bounding_radius_ = 0.0f;
+    for (unsigned int i = 0; i < mesh.vertexCount; ++i) {
+        bounding_radius_ = std::max(bounding_radius_, glm::length(mesh.positions[i]));
+    }
+
+    bool uploaded;
+    if (quantize) {
+        std::vector<glm::vec3> vertices(mesh.positions, mesh.positions + mesh.vertexCount);
+        std::vector<glm::vec2> uvs(mesh.uvs, mesh.uvs + mesh.vertexCount);
+        std::vector<glm::vec3> normals(mesh.normals, mesh.normals + mesh.vertexCount);
+
+        std::vector<QuantizedVertex> quantized;
+        QuantizationParams params;
+        quantizeVertices(vertices, uvs, normals, quantized, params);
+        position_offset_ = params.offset;
+        position_scale_ = params.scale;
+
+        uploaded = arena.upload(quantized, mesh.indices, mesh.indexCount, range_);
+    } else {
+        position_offset_ = glm::vec3(0.0f);
+        position_scale_ = glm::vec3(1.0f);
+
+        // A vertex in one fetch, instead of one per buffer
+        std::vector<FloatVertex> interleaved(mesh.vertexCount);
+        for (unsigned int i = 0; i < mesh.vertexCount; ++i) {
+            interleaved[i].position = mesh.positions[i];
+            interleaved[i].uv = mesh.uvs[i];
+        }
+        uploaded = arena.upload(interleaved, mesh.indices, mesh.indexCount, range_);
+    }
+    arena_ = &arena;
+
+    // The LODs index ranges of the mesh's part of the index buffer
+    lods_.clear();
+    for (unsigned int i = 0; i < mesh.lodCount; ++i) {
+        const MeshBinLod &lod = mesh.lods[i];
+        lods_.push_back({static_cast<GLsizei>(lod.indexCount),
+                         (range_.first_index + lod.indexOffset) * sizeof(unsigned int), lod.error});
+    }
+    meshlets_.assign(mesh.meshlets, mesh.meshlets + mesh.meshletCount);
+    positions_.assign(mesh.positions, mesh.positions + mesh.vertexCount);
+    indices_.assign(mesh.indices, mesh.indices + mesh.indexCount);
+
+    // The driver has its own copy now
+    closeMeshBin(mesh);
+    return uploaded;
+}
+
+void Mesh::release() {
+    if (arena_ != nullptr) {
+        arena_->free(range_);
+    }
+    arena_ = nullptr;
+    range_ = GeometryRange();
+    vertex_count_ = 0;
+    index_count_ = 0;
+    quantized_ = false;
+    lods_.clear();
+    meshlets_.clear();
+    positions_.clear();
+    indices_.clear();
+}
+
+GLuint Mesh::get_vertex_array_id() const {
+    return arena_->get_vertex_array_id();
+}
+
+unsigned int Mesh::get_id() const {
+    return id_;
+}
+
+GLsizei Mesh::get_vertex_count() const {
+    return vertex_count_;
+}
+
+GLsizei Mesh::get_index_count() const {
+    return index_count_;
+}
+
+size_t Mesh::get_lod_count() const {
+    return lods_.size();
+}
+
+GLsizei Mesh::get_lod_index_count(size_t lod) const {
+    return lods_[lod].index_count;
+}
+
+size_t Mesh::get_lod_first_index(size_t lod) const {
+    return lods_[lod].index_offset / sizeof(unsigned int);
+}
+
+GLfloat Mesh::get_lod_error(size_t lod) const {
+    return lods_[lod].error;
+}
+
+GLint Mesh::get_base_vertex() const {
+    return static_cast<GLint>(range_.first_vertex);
+}
+
+const std::vector<glm::vec3> &Mesh::get_positions() const {
+    return positions_;
+}
+
+const unsigned int *Mesh::get_lod_indices(size_t lod) const {
+    return indices_.data() + get_lod_first_index(lod) - range_.first_index;
+}
+
+GLfloat Mesh::get_bounding_radius() const {
+    return bounding_radius_;
+}
+
+size_t Mesh::select_lod(glm::vec3 position, GLfloat scale, const LodView &view) const {
+    GLfloat distance = glm::distance(position, view.camera_position);
+    size_t lod = 0;
+    // The errors only grow along the chain
+    while (lod + 1 < lods_.size() &&
+           lods_[lod + 1].error * scale * view.pixels_per_unit < kLodPixelError * distance) {
+        ++lod;
+    }
+    return lod;
+}
+
+bool Mesh::is_quantized() const {
+    return quantized_;
+}
+
+glm::vec3 Mesh::get_position_offset() const {
+    return position_offset_;
+}
+
+glm::vec3 Mesh::get_position_scale() const {
+    return position_scale_;
+}
+
+template <typename Visible>
+void Mesh::collect_visible_meshlets(Visible is_visible) const {
+    // Consecutive visible meshlets are consecutive in the index buffer : merge them
+    const GLint base_vertex = static_cast<GLint>(range_.first_vertex);
+    draw_counts_.clear();
+    draw_offsets_.clear();
+    draw_base_vertices_.clear();
+    bool previous_visible = false;
+    for (const Meshlet &meshlet : meshlets_) {
+        bool visible = is_visible(meshlet);
+        if (visible && previous_visible) {
+            draw_counts_.back() += meshlet.triangleCount * 3;
+        } else if (visible) {
+            draw_counts_.push_back(meshlet.triangleCount * 3);
+            draw_offsets_.push_back(
+                    reinterpret_cast<const void *>((range_.first_index + meshlet.indexOffset) * sizeof(unsigned int)));
+            draw_base_vertices_.push_back(base_vertex);
+        }
+        previous_visible = visible;
+    }
+}
+
+void Mesh::draw(size_t lod, glm::vec3 camera_modelspace) const {
+    if (lod != 0 || meshlets_.empty()) {
+        glDrawElementsBaseVertex(GL_TRIANGLES, lods_[lod].index_count, GL_UNSIGNED_INT,
+                                 reinterpret_cast<void *>(lods_[lod].index_offset),
+                                 static_cast<GLint>(range_.first_vertex));
+        return;
+    }
+
+    collect_visible_meshlets([&](const Meshlet &meshlet) {
+        return !isMeshletBackfacing(meshlet, camera_modelspace);
+    });
+    if (!draw_counts_.empty()) {
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, draw_counts_.data(), GL_UNSIGNED_INT, draw_offsets_.data(),
+                                      static_cast<GLsizei>(draw_counts_.size()), draw_base_vertices_.data());
+    }
+}
+
+void Mesh::draw_instanced(size_t lod, GLsizei instance_count, const std::vector<glm::vec3> &cameras_modelspace) const {
+    if (lod != 0 || meshlets_.empty() || cameras_modelspace.empty()) {
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lods_[lod].index_count, GL_UNSIGNED_INT,
+                                          reinterpret_cast<void *>(lods_[lod].index_offset), instance_count,
+                                          static_cast<GLint>(range_.first_vertex));
+        return;
+    }
+
+    // A meshlet is drawn for every instance, so it can only go when none
+    // of them sees it. GL 3.3 has no instanced multi-draw : one call per range.
+    collect_visible_meshlets([&](const Meshlet &meshlet) {
+        for (const glm::vec3 &camera : cameras_modelspace) {
+            if (!isMeshletBackfacing(meshlet, camera)) {
+                return true;
+            }
+        }
+        return false;
+    });
+    for (size_t i = 0; i < draw_counts_.size(); ++i) {
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, draw_counts_[i], GL_UNSIGNED_INT, draw_offsets_[i],
+                                          instance_count, draw_base_vertices_[i]);
+    }
+}
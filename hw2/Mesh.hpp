@@ -0,0 +1,126 @@
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <common/vbomeshlets.hpp>
+
+#include "GeometryArena.hpp"
+
+#ifndef HW2_MESH
+#define HW2_MESH
+
+// What LOD selection needs to know about the camera
+struct LodView {
+    glm::vec3 camera_position;
+    // Pixels covered by one unit seen at a distance of 1
+    GLfloat pixels_per_unit;
+};
+
+class Mesh {
+public:
+    // Loads the mesh through its .meshbin cache and copies its interleaved
+    // vertices and its indices into the arena. With quantize, the vertices
+    // are QuantizedVertex (12 bytes instead of 20) and the error it
+    // introduces is printed. The arena must have been set up for
+    // QuantizedVertexLayout then, and for FloatVertexLayout otherwise.
+    bool load(const char *obj_path, GeometryArena &arena, bool quantize = false);
+
+    // Gives the mesh's ranges back to the arena
+    void release();
+
+    // Shared with every other mesh of the arena
+    GLuint get_vertex_array_id() const;
+
+    // Tells the loaded meshes apart, small and never reused
+    unsigned int get_id() const;
+
+    GLsizei get_vertex_count() const;
+
+    // Of the full mesh
+    GLsizei get_index_count() const;
+
+    size_t get_lod_count() const;
+
+    // Where a LOD's indices are in the arena's index buffer
+    GLsizei get_lod_index_count(size_t lod) const;
+
+    size_t get_lod_first_index(size_t lod) const;
+
+    // In model units
+    GLfloat get_lod_error(size_t lod) const;
+
+    // Added to the indices by the draws of the mesh
+    GLint get_base_vertex() const;
+
+    // CPU copies of the model space positions and of the indices of a LOD,
+    // get_lod_index_count of them, for software rasterization
+    const std::vector<glm::vec3> &get_positions() const;
+
+    const unsigned int *get_lod_indices(size_t lod) const;
+
+    // Of the sphere around the model space origin holding every vertex
+    GLfloat get_bounding_radius() const;
+
+    // The coarsest LOD whose error covers less than kLodPixelError on
+    // screen, for this mesh drawn at position with a uniform scale
+    size_t select_lod(glm::vec3 position, GLfloat scale, const LodView &view) const;
+
+    bool is_quantized() const;
+
+    // Uniforms of the vertex shader : position = offset + attribute * scale.
+    // (0, 0, 0) and (1, 1, 1) for a float mesh.
+    glm::vec3 get_position_offset() const;
+
+    glm::vec3 get_position_scale() const;
+
+    // Draws the triangles of a LOD, with the vertex array bound : attributes
+    // 0 (position), 1 (uv) and, for a quantized mesh, 2 (octahedral normal),
+    // and the index buffer. The full LOD skips the meshlets facing away from
+    // the camera.
+    void draw(size_t lod, glm::vec3 camera_modelspace) const;
+
+    // Draws instance_count copies of a LOD, with the vertex array bound and
+    // the per-instance attributes set up in it. cameras_modelspace holds the
+    // camera seen from each instance : the full LOD skips the meshlets all
+    // of them face away from, with one call per range of the others.
+    // Without cameras, everything is drawn in one call.
+    void draw_instanced(size_t lod, GLsizei instance_count, const std::vector<glm::vec3> &cameras_modelspace) const;
+
+    // Largest error on screen, in pixels, of the LOD select_lod picks
+    constexpr static GLfloat kLodPixelError = 1.0f;
+
+private:
+    struct Lod {
+        GLsizei index_count;
+        size_t index_offset; // in bytes
+        GLfloat error;       // in model units
+    };
+
+    unsigned int id_ = 0;
+    GeometryArena *arena_ = nullptr;
+    GeometryRange range_;
+    GLsizei vertex_count_ = 0;
+    GLsizei index_count_ = 0;
+    GLfloat bounding_radius_ = 0.0f;
+    bool quantized_ = false;
+    glm::vec3 position_offset_ = glm::vec3(0.0f);
+    glm::vec3 position_scale_ = glm::vec3(1.0f);
+    std::vector<Lod> lods_;
+    std::vector<Meshlet> meshlets_;
+    std::vector<glm::vec3> positions_;
+    std::vector<unsigned int> indices_;
+
+    // Ranges of the visible meshlets, rebuilt on every draw
+    mutable std::vector<GLsizei> draw_counts_;
+    mutable std::vector<const void *> draw_offsets_;
+    mutable std::vector<GLint> draw_base_vertices_;
+
+private:
+    // Fills the draw ranges with the meshlets of the full LOD for which
+    // is_visible(meshlet) holds, merging neighbours
+    template <typename Visible>
+    void collect_visible_meshlets(Visible is_visible) const;
+};
+
+#endif //HW2_MESH
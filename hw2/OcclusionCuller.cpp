@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "EntityStore.hpp"
+#include "OcclusionCuller.hpp"
+
+OcclusionCuller::OcclusionCuller(int width, int height) {
+    resizeDepthBuffer(depth_buffer_, width, height);
+}
+
+void OcclusionCuller::render_occluders(const std::vector<size_t> &indices,
+                                       const std::function<InstanceData(size_t)> &get_instance, const Mesh &mesh,
+                                       const glm::mat4 &view, const glm::mat4 &projection, JobSystem &jobs) {
+    auto start = std::chrono::steady_clock::now();
+    stats_ = OcclusionStats();
+    view_ = view;
+    projection_ = projection;
+    clearDepthBuffer(depth_buffer_);
+
+    // The nearest ones hide the most
+    glm::vec3 camera_position = glm::vec3(glm::inverse(view)[3]);
+    occluders_.clear();
+    for (size_t index : indices) {
+        occluders_.emplace_back(glm::distance(get_instance(index).position, camera_position), index);
+    }
+    size_t occluder_count = std::min(occluders_.size(), kMaxOccluders);
+    std::partial_sort(occluders_.begin(), occluders_.begin() + occluder_count, occluders_.end());
+
+    const GLfloat width = static_cast<GLfloat>(depth_buffer_.width);
+    const GLfloat height = static_cast<GLfloat>(depth_buffer_.height);
+    const std::vector<glm::vec3> &positions = mesh.get_positions();
+    triangles_.clear();
+    for (size_t o = 0; o < occluder_count; ++o) {
+        InstanceData instance = get_instance(occluders_[o].second);
+        GLfloat c = std::cos(instance.spin_angle) * instance.scale;
+        GLfloat s = std::sin(instance.spin_angle) * instance.scale;
+        glm::mat4 model(1.0f);
+        model[0] = glm::vec4(c, s, 0.0f, 0.0f);
+        model[1] = glm::vec4(-s, c, 0.0f, 0.0f);
+        model[2] = glm::vec4(0.0f, 0.0f, instance.scale, 0.0f);
+        model[3] = glm::vec4(instance.position, 1.0f);
+        glm::mat4 MVP = projection * view * model;
+
+        clip_positions_.resize(positions.size());
+        for (size_t v = 0; v < positions.size(); ++v) {
+            clip_positions_[v] = MVP * glm::vec4(positions[v], 1.0f);
+        }
+
+        const unsigned int *indices_of_lod = mesh.get_lod_indices(0);
+        GLsizei index_count = mesh.get_lod_index_count(0);
+        for (GLsizei i = 0; i + 2 < index_count; i += 3) {
+            ScreenTriangle triangle;
+            bool in_front = true;
+            for (int k = 0; k < 3; ++k) {
+                const glm::vec4 &clip = clip_positions_[indices_of_lod[i + k]];
+                // Leaving out an occluder triangle only hides less
+                if (clip.w < kNearPlane) {
+                    in_front = false;
+                    break;
+                }
+                GLfloat inv_w = 1 / clip.w;
+                triangle.x[k] = (clip.x * inv_w * 0.5f + 0.5f) * width;
+                triangle.y[k] = (clip.y * inv_w * 0.5f + 0.5f) * height;
+                triangle.invW[k] = inv_w;
+            }
+            if (in_front) {
+                triangles_.push_back(triangle);
+            }
+        }
+    }
+    stats_.occluder_triangles = triangles_.size();
+
+    // Bands of rows don't share pixels
+    size_t band_count = (depth_buffer_.height + kBandRows - 1) / kBandRows;
+    jobs.parallelFor(0, band_count, 1, [&](size_t begin, size_t end) {
+        for (size_t band = begin; band < end; ++band) {
+            int first_row = static_cast<int>(band) * kBandRows;
+            rasterizeTriangles(depth_buffer_, triangles_, first_row,
+                               std::min(first_row + kBandRows, depth_buffer_.height));
+        }
+    });
+    buildDepthPyramid(depth_buffer_);
+
+    stats_.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void OcclusionCuller::cull(std::vector<size_t> &indices, const std::function<InstanceData(size_t)> &get_instance,
+                           GLfloat bounding_radius, JobSystem &jobs) {
+    auto start = std::chrono::steady_clock::now();
+
+    visible_.resize(indices.size());
+    jobs.parallelFor(0, indices.size(), EntityStore::kJobGrainSize, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            InstanceData instance = get_instance(indices[i]);
+            visible_[i] = is_sphere_visible(instance.position, instance.scale * bounding_radius);
+        }
+    });
+
+    size_t kept = 0;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        if (visible_[i]) {
+            indices[kept++] = indices[i];
+        }
+    }
+    stats_.tested_objects += indices.size();
+    stats_.culled_objects += indices.size() - kept;
+    indices.resize(kept);
+
+    stats_.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool OcclusionCuller::is_sphere_visible(glm::vec3 center, GLfloat radius) const {
+    glm::vec4 view_center = view_ * glm::vec4(center, 1.0f);
+    GLfloat w = -view_center.z;
+    // Touching the near plane : can't be behind anything
+    if (w - radius < kNearPlane) {
+        return true;
+    }
+
+    // x / w and y / w over the box around the sphere peak at its corners
+    const GLfloat x_scale = projection_[0][0];
+    const GLfloat y_scale = projection_[1][1];
+    GLfloat min_x = HUGE_VALF, max_x = -HUGE_VALF, min_y = HUGE_VALF, max_y = -HUGE_VALF;
+    for (GLfloat corner_w : {w - radius, w + radius}) {
+        for (GLfloat sign : {-1.0f, 1.0f}) {
+            GLfloat x = x_scale * (view_center.x + sign * radius) / corner_w;
+            GLfloat y = y_scale * (view_center.y + sign * radius) / corner_w;
+            min_x = std::min(min_x, x);
+            max_x = std::max(max_x, x);
+            min_y = std::min(min_y, y);
+            max_y = std::max(max_y, y);
+        }
+    }
+    const GLfloat width = static_cast<GLfloat>(depth_buffer_.width);
+    const GLfloat height = static_cast<GLfloat>(depth_buffer_.height);
+    return isRectVisible(depth_buffer_, (min_x * 0.5f + 0.5f) * width, (min_y * 0.5f + 0.5f) * height,
+                         (max_x * 0.5f + 0.5f) * width, (max_y * 0.5f + 0.5f) * height, 1 / (w - radius));
+}
+
+const OcclusionStats &OcclusionCuller::get_stats() const {
+    return stats_;
+}
+
+const DepthBuffer &OcclusionCuller::get_depth_buffer() const {
+    return depth_buffer_;
+}
+
+const glm::mat4 &OcclusionCuller::get_view() const {
+    return view_;
+}
+
+const glm::mat4 &OcclusionCuller::get_projection() const {
+    return projection_;
+}
@@ -0,0 +1,78 @@
+#include <functional>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <common/jobsystem.hpp>
+#include <common/depthraster.hpp>
+
+#include "Mesh.hpp"
+#include "InstanceBatch.hpp"
+
+#ifndef HW2_OCCLUSION_CULLER
+#define HW2_OCCLUSION_CULLER
+
+// What the last frame did
+struct OcclusionStats {
+    size_t occluder_triangles = 0;
+    size_t tested_objects = 0;
+    size_t culled_objects = 0;
+    double milliseconds = 0.0;
+};
+
+// Software occlusion culling. The nearest targets are rasterized on the
+// threads into a low resolution depth buffer, then the bounding spheres of
+// the objects that passed frustum culling are tested against its
+// hierarchical Z pyramid. All of it runs on the CPU before the frame's GL
+// calls, while the GPU still works on the previous frame.
+class OcclusionCuller {
+public:
+    // Resolution of the depth buffer
+    OcclusionCuller(int width, int height);
+
+    // Clears the depth buffer and the stats, and rasterizes the
+    // kMaxOccluders instances nearest to the camera among indices. Always
+    // their full LOD : a simplified one can stick out of the real surface.
+    void render_occluders(const std::vector<size_t> &indices, const std::function<InstanceData(size_t)> &get_instance,
+                          const Mesh &mesh, const glm::mat4 &view, const glm::mat4 &projection, JobSystem &jobs);
+
+    // Removes from indices the instances whose bounding sphere is hidden
+    // behind the occluders. Keeps the order of the others.
+    void cull(std::vector<size_t> &indices, const std::function<InstanceData(size_t)> &get_instance,
+              GLfloat bounding_radius, JobSystem &jobs);
+
+    // Whether a sphere is at least partly in front of the occluders : the
+    // test cull runs on each instance
+    bool is_sphere_visible(glm::vec3 center, GLfloat radius) const;
+
+    const OcclusionStats &get_stats() const;
+
+    // What the last render_occluders drew, and from where : GpuCuller tests
+    // against the same pyramid
+    const DepthBuffer &get_depth_buffer() const;
+    const glm::mat4 &get_view() const;
+    const glm::mat4 &get_projection() const;
+
+    // Of the projection : nothing nearer is rasterized or tested
+    constexpr static GLfloat kNearPlane = 0.1f;
+
+private:
+    DepthBuffer depth_buffer_;
+    glm::mat4 view_;
+    glm::mat4 projection_;
+
+    std::vector<std::pair<GLfloat, size_t>> occluders_;
+    std::vector<glm::vec4> clip_positions_;
+    std::vector<ScreenTriangle> triangles_;
+    std::vector<char> visible_;
+
+    OcclusionStats stats_;
+
+private:
+    constexpr static size_t kMaxOccluders = 8;
+    // Rows rasterized by one job
+    constexpr static int kBandRows = 8;
+};
+
+#endif //HW2_OCCLUSION_CULLER
@@ -0,0 +1,111 @@
+#include <cstring>
+
+#include "InstanceBatch.hpp"
+#include "RenderQueue.hpp"
+
+Material make_material(GLuint programID, const Mesh &mesh, GLuint textureID) {
+    Material material;
+    material.program_id = programID;
+    material.texture_id = textureID;
+    material.mesh = &mesh;
+    material.matrix_location = glGetUniformLocation(programID, "MVP");
+    material.rotate_location = glGetUniformLocation(programID, "rotation_matrix");
+    material.position_offset_location = glGetUniformLocation(programID, "position_offset");
+    material.position_scale_location = glGetUniformLocation(programID, "position_scale");
+    return material;
+}
+
+void RenderQueue::push(const Material &material, const AffineMatrix &transform, glm::vec3 camera_modelspace,
+                       size_t lod, GLfloat depth) {
+    add({&material, nullptr, transform, camera_modelspace, lod}, depth);
+}
+
+void RenderQueue::push(InstanceBatch &batch) {
+    if (!batch.empty()) {
+        add({&batch.get_material(), &batch, AffineMatrix(), glm::vec3(0.0f), 0}, 0.0f);
+    }
+}
+
+void RenderQueue::submit(const glm::mat4 &MVP, GLStateTracker &state) {
+    sort_entries();
+
+    for (const SortEntry &entry : entries_) {
+        DrawItem &item = items_[entry.item];
+        const Material &material = *item.material;
+        const Mesh &mesh = *material.mesh;
+
+        state.use_program(material.program_id);
+        if (state.need_frame_uniforms(material.program_id)) {
+            glUniformMatrix4fv(material.matrix_location, 1, GL_FALSE, &MVP[0][0]);
+        }
+        if (state.need_mesh_uniforms(material.program_id, mesh)) {
+            glm::vec3 position_offset = mesh.get_position_offset();
+            glm::vec3 position_scale = mesh.get_position_scale();
+            glUniform3fv(material.position_offset_location, 1, &position_offset[0]);
+            glUniform3fv(material.position_scale_location, 1, &position_scale[0]);
+        }
+        // The samplers of the programs all read unit 0
+        state.bind_texture(0, material.texture_id);
+        state.bind_vertex_array(mesh.get_vertex_array_id());
+
+        if (item.batch != nullptr) {
+            item.batch->draw_instances();
+        } else {
+            glUniformMatrix4x3fv(material.rotate_location, 1, GL_TRUE, &item.transform.rows[0][0]);
+            mesh.draw(item.lod, item.camera_modelspace);
+        }
+    }
+
+    items_.clear();
+    entries_.clear();
+}
+
+size_t RenderQueue::size() const {
+    return items_.size();
+}
+
+void RenderQueue::add(const DrawItem &item, GLfloat depth) {
+    entries_.push_back({make_key(*item.material, depth), static_cast<uint32_t>(items_.size())});
+    items_.push_back(item);
+}
+
+uint64_t RenderQueue::make_key(const Material &material, GLfloat depth) {
+    // GL names are small integers. Two names sharing their low bits only
+    // end up interleaved in the order, the tracker still binds what's needed.
+    // Every mesh shares the arena's vertex array : the mesh id keeps the
+    // draws of a mesh together, for its dequantization uniforms.
+    uint64_t program = material.program_id & 0xfff;
+    uint64_t texture = material.texture_id & 0xfff;
+    uint64_t mesh = material.mesh->get_id() & 0xff;
+
+    // The bits of a non-negative float sort like the float
+    depth = depth > 0.0f ? depth : 0.0f;
+    uint32_t depth_bits;
+    memcpy(&depth_bits, &depth, sizeof(depth_bits));
+
+    return program << 52 | texture << 40 | mesh << 32 | depth_bits;
+}
+
+void RenderQueue::sort_entries() {
+    sort_buffer_.resize(entries_.size());
+    for (unsigned int shift = 0; shift < 64; shift += 8) {
+        size_t counts[256] = {};
+        for (const SortEntry &entry : entries_) {
+            ++counts[(entry.key >> shift) & 0xff];
+        }
+        if (entries_.empty() || counts[(entries_[0].key >> shift) & 0xff] == entries_.size()) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (size_t &count : counts) {
+            size_t bucket_size = count;
+            count = offset;
+            offset += bucket_size;
+        }
+        for (const SortEntry &entry : entries_) {
+            sort_buffer_[counts[(entry.key >> shift) & 0xff]++] = entry;
+        }
+        entries_.swap(sort_buffer_);
+    }
+}
@@ -0,0 +1,82 @@
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <common/trsbatch.hpp>
+
+#include "Mesh.hpp"
+#include "GLStateTracker.hpp"
+
+#ifndef HW2_RENDER_QUEUE
+#define HW2_RENDER_QUEUE
+
+class InstanceBatch;
+
+// What a kind of object looks like : the state its draws set up, and the
+// uniform locations of its program
+struct Material {
+    GLuint program_id = 0;
+    GLuint texture_id = 0;
+    const Mesh *mesh = nullptr;
+
+    GLint matrix_location = -1;
+    GLint rotate_location = -1;
+    GLint position_offset_location = -1;
+    GLint position_scale_location = -1;
+};
+
+Material make_material(GLuint programID, const Mesh &mesh, GLuint textureID);
+
+// The draws of a frame. They are recorded in any order, then sorted by
+// program, texture, mesh, and front to back, so that submitting them goes
+// through each state change once.
+class RenderQueue {
+public:
+    // One object, drawn with its own model matrix. depth is its distance to
+    // the camera.
+    void push(const Material &material, const AffineMatrix &transform, glm::vec3 camera_modelspace, size_t lod,
+              GLfloat depth);
+
+    // All the instances of a batch, drawn by the batch once the state of
+    // its material is set up. Empty batches are left out.
+    void push(InstanceBatch &batch);
+
+    // Sorts the draws, issues them, and forgets them
+    void submit(const glm::mat4 &MVP, GLStateTracker &state);
+
+    size_t size() const;
+
+private:
+    struct DrawItem {
+        const Material *material;
+        // Not null for instanced draws, which don't use the fields below
+        InstanceBatch *batch;
+        AffineMatrix transform;
+        glm::vec3 camera_modelspace;
+        size_t lod;
+    };
+
+    struct SortEntry {
+        uint64_t key;
+        uint32_t item;
+    };
+
+    void add(const DrawItem &item, GLfloat depth);
+
+    // Program, texture and mesh from the high bits down, then the depth.
+    // The vertex array is left to the state tracker.
+    static uint64_t make_key(const Material &material, GLfloat depth);
+
+    // LSD radix sort of entries_ on the keys, a byte per pass. Stable, and
+    // the passes where every key has the same byte are skipped.
+    void sort_entries();
+
+private:
+    std::vector<DrawItem> items_;
+    std::vector<SortEntry> entries_;
+    std::vector<SortEntry> sort_buffer_;
+};
+
+#endif //HW2_RENDER_QUEUE
@@ -1,73 +1,42 @@
 #include "Target.hpp"
 
-Target::Target(GLuint programID, GLuint verticesBufferID, GLuint colorsBufferID, size_t verticesCount) :
-        program_id_(programID),
-        vertex_buffer_id_(verticesBufferID),
-        uv_buffer_id_(colorsBufferID),
-        vertex_count_(verticesCount) {
-    matrix_location_ = glGetUniformLocation(programID, "MVP");
-    rotate_location_ = glGetUniformLocation(programID, "rotation_matrix");
-    texture_location_ = glGetUniformLocation(programID, "myTextureSampler");
+Target::Target(GLuint programID, const Mesh &mesh, GLuint textureID) :
+        renderer_(programID, mesh, textureID, get_instance) {
 }
 
-void Target::set_coordinates(glm::vec3 coordinates) {
-    coordinates_ = coordinates;
+EntityHandle Target::spawn(EntityStore &targets, glm::vec3 coordinates) {
+    return targets.create(coordinates, glm::vec3(0.0f), 0.0f);
 }
 
-void Target::set_texture(GLuint textureID) {
-    texture_id_ = textureID;
+void Target::update(EntityStore &targets, GLfloat dt, JobSystem &jobs) {
+    std::vector<GLfloat> &spin_angles = targets.get_spin_angles();
+    jobs.parallelFor(0, targets.size(), EntityStore::kJobGrainSize, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            GLfloat angle = spin_angles[i] + kSpinSpeed * dt;
+
+            // Normalize angle, so that -pi <= angle <= pi
+            GLint n = angle / kPi;
+            spin_angles[i] = angle - 2 * kPi * n;
+        }
+    });
 }
 
-bool Target::is_close_to_point(glm::vec3 point) {
-    return glm::distance(point, coordinates_) < 0.5;
-}
-
-void Target::calculate_rotation_matrix(glm::mat4 &rotation_matrix) {
-    current_spin_angle_ += kAngleStep;
-
-    // Normalize angle, so that -pi <= angle <= pi
-    GLint n = current_spin_angle_ / kPi;
-    current_spin_angle_ -= 2 * kPi * n;
-
+InstanceData Target::get_instance(const EntityStore &targets, size_t index, GLfloat alpha) {
     // Scale model, so that distant objects look smaller
-    GLfloat scale = 1 / glm::length(coordinates_);
-    rotation_matrix = glm::translate(glm::mat4(), coordinates_) *
-                      glm::rotate(glm::mat4(1.0f), current_spin_angle_, glm::vec3(0, 0, 1)) *
-                      glm::scale(glm::mat4(), glm::vec3(scale, scale, scale));
+    glm::vec3 coordinates = targets.get_positions()[index];
+    return {coordinates, targets.get_interpolated_spin_angle(index, alpha), 1 / glm::length(coordinates)};
 }
 
-void Target::enable_attribute_buffer(size_t attribute_id, size_t attribute_size, GLuint buffer) {
-    glEnableVertexAttribArray(attribute_id);
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glVertexAttribPointer(attribute_id, attribute_size, GL_FLOAT, GL_FALSE, 0, nullptr);
+bool Target::is_close_to_point(glm::vec3 coordinates, glm::vec3 point) {
+    return glm::distance(point, coordinates) < kHitRadius;
 }
 
-void Target::draw(const glm::mat4 &MVP) {
-    // Use our shader
-    glUseProgram(program_id_);
-
-    // Send our transformation to the currently bound shader, in the "MVP" uniform
-    glm::mat4 rotation_matrix;
-    calculate_rotation_matrix(rotation_matrix);
-    glUniformMatrix4fv(matrix_location_, 1, GL_FALSE, &MVP[0][0]);
-    glUniformMatrix4fv(rotate_location_, 1, GL_FALSE, &rotation_matrix[0][0]);
-
-    // Bind our texture in Texture Unit 0
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture_id_);
-
-    // Set our "myTextureSampler" sampler to use Texture Unit 0
-    glUniform1i(texture_location_, 0);
-
-    // vertices
-    enable_attribute_buffer(0, 3, vertex_buffer_id_);
-    // colors
-    enable_attribute_buffer(1, 2, uv_buffer_id_);
-
-    // Draw triangles
-    glDrawArrays(GL_TRIANGLES, 0, vertex_count_);
+void Target::record(const EntityStore &targets, const std::vector<size_t> &indices, RenderQueue &queue,
+                    const LodView &view, GLfloat alpha) const {
+    renderer_.record(targets, indices, queue, view, alpha);
+}
 
-    // Disable attribute arrays
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
-}
\ No newline at end of file
+void Target::add_to(const EntityStore &targets, const std::vector<size_t> &indices, InstanceBatch &batch,
+                    const LodView &view, GLfloat alpha, JobSystem &jobs) {
+    EntityRenderer::add_to(targets, indices, get_instance, batch, view, alpha, jobs);
+}
@@ -2,44 +2,50 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <vector>
+
+#include <common/jobsystem.hpp>
+
+#include "Mesh.hpp"
+#include "EntityStore.hpp"
+#include "EntityRenderer.hpp"
+
 #ifndef HW2_TARGET
 #define HW2_TARGET
 
+// How targets behave and look. The targets themselves live in an
+// EntityStore : standing at their position, spinning around Z.
 class Target {
 public:
-    Target(GLuint programID, GLuint verticesBufferID, GLuint colorsBufferID, size_t verticesCount);
+    Target(GLuint programID, const Mesh &mesh, GLuint textureID);
 
-    void set_coordinates(glm::vec3 coordinates);
+    static EntityHandle spawn(EntityStore &targets, glm::vec3 coordinates);
 
-    void set_texture(GLuint textureID);
+    // Spins every target for dt seconds
+    static void update(EntityStore &targets, GLfloat dt, JobSystem &jobs);
 
-    bool is_close_to_point(glm::vec3 point);
+    // alpha blends the last two simulation steps, see EntityStore
+    static InstanceData get_instance(const EntityStore &targets, size_t index, GLfloat alpha);
 
-    void draw(const glm::mat4 &MVP);
+    // Closer than kHitRadius
+    static bool is_close_to_point(glm::vec3 coordinates, glm::vec3 point);
 
-private:
-    void calculate_rotation_matrix(glm::mat4 &rotation_matrix);
+    // Queues one draw for each of the targets at these indices
+    void record(const EntityStore &targets, const std::vector<size_t> &indices, RenderQueue &queue,
+                const LodView &view, GLfloat alpha) const;
 
-private:
-    static void enable_attribute_buffer(size_t attribute_id, size_t attribute_size, GLuint buffer);
+    // Hands the targets at these indices to the batch instead of drawing them
+    static void add_to(const EntityStore &targets, const std::vector<size_t> &indices, InstanceBatch &batch,
+                       const LodView &view, GLfloat alpha, JobSystem &jobs);
 
-private:
-    glm::vec3 coordinates_;
-
-    GLint texture_location_ = 0;
-    GLint rotate_location_ = 0;
-    GLint matrix_location_ = 0;
+    constexpr static GLfloat kHitRadius = 0.5f;
 
-    GLuint vertex_buffer_id_ = 0;
-    GLuint uv_buffer_id_ = 0;
-    GLuint program_id_ = 0;
-    GLuint texture_id_ = 0;
-
-    GLfloat current_spin_angle_ = 0.0f;
-    GLuint vertex_count_ = 0;
+private:
+    EntityRenderer renderer_;
 
 private:
-    constexpr static GLfloat kAngleStep = 0.002f;
+    // Radians per second
+    constexpr static GLfloat kSpinSpeed = 0.12f;
 
     constexpr static auto kPi = glm::pi<GLfloat>();
 };
@@ -0,0 +1,333 @@
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <tuple>
+#include <iterator>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <common/shader.hpp>
+#include <common/jobsystem.hpp>
+#include <common/vbosimplifier.hpp>
+#include <common/vbomeshlets.hpp>
+#include <common/meshcache.hpp>
+
+#include "Target.hpp"
+#include "Fireball.hpp"
+#include "EntityStore.hpp"
+#include "LooseOctree.hpp"
+#include "GLStateTracker.hpp"
+#include "GeometryArena.hpp"
+#include "VertexLayout.hpp"
+#include "OcclusionCuller.hpp"
+#include "Validation.hpp"
+
+// Whether the CPU keeps the instance, and at which LOD, changes when its
+// bounding sphere and its LOD errors are kTolerance smaller or larger
+static bool is_borderline(const InstanceData &instance, const Mesh &mesh, const LodView &view,
+                          const Frustum &frustum, const OcclusionCuller *occlusion) {
+    constexpr GLfloat kTolerance = 1e-3f;
+
+    bool visible[2];
+    size_t lods[2];
+    for (int k = 0; k < 2; ++k) {
+        GLfloat scale = instance.scale * (k == 0 ? 1 - kTolerance : 1 + kTolerance);
+        GLfloat radius = scale * mesh.get_bounding_radius();
+        visible[k] = true;
+        for (const glm::vec4 &plane : frustum.planes) {
+            visible[k] = visible[k] && glm::dot(glm::vec3(plane), instance.position) + plane.w >= -radius;
+        }
+        if (occlusion != nullptr) {
+            visible[k] = visible[k] && occlusion->is_sphere_visible(instance.position, radius);
+        }
+        lods[k] = mesh.select_lod(instance.position, scale, view);
+    }
+    return visible[0] != visible[1] || lods[0] != lods[1];
+}
+
+size_t validate_gpu_culling(const char *name, const GpuCuller &culler, size_t culler_mesh,
+                            const std::vector<size_t> &visible_indices,
+                            const std::function<InstanceData(size_t)> &get_instance, const Mesh &mesh,
+                            const LodView &view, const Frustum &frustum, const OcclusionCuller *occlusion) {
+    typedef std::tuple<size_t, GLfloat, GLfloat, GLfloat> Visible;
+    std::vector<InstanceData> gpu_instances;
+    std::vector<size_t> gpu_lods;
+    culler.read_visible(culler_mesh, gpu_instances, gpu_lods);
+
+    std::vector<Visible> gpu_visible;
+    for (size_t i = 0; i < gpu_instances.size(); ++i) {
+        glm::vec3 position = gpu_instances[i].position;
+        gpu_visible.emplace_back(gpu_lods[i], position.x, position.y, position.z);
+    }
+    std::vector<InstanceData> cpu_instances;
+    std::vector<Visible> cpu_visible;
+    for (size_t index : visible_indices) {
+        InstanceData instance = get_instance(index);
+        cpu_instances.push_back(instance);
+        glm::vec3 position = instance.position;
+        cpu_visible.emplace_back(mesh.select_lod(position, instance.scale, view), position.x, position.y,
+                                 position.z);
+    }
+
+    std::sort(gpu_visible.begin(), gpu_visible.end());
+    std::sort(cpu_visible.begin(), cpu_visible.end());
+    std::vector<Visible> differences;
+    std::set_symmetric_difference(gpu_visible.begin(), gpu_visible.end(), cpu_visible.begin(), cpu_visible.end(),
+                                  std::back_inserter(differences));
+
+    // Each difference is an instance only one side kept, or kept at another
+    // LOD : either way one side has it
+    size_t borderline = 0;
+    for (const Visible &difference : differences) {
+        glm::vec3 position(std::get<1>(difference), std::get<2>(difference), std::get<3>(difference));
+        auto same_position = [&](const InstanceData &instance) { return instance.position == position; };
+        auto found = std::find_if(gpu_instances.begin(), gpu_instances.end(), same_position);
+        if (found == gpu_instances.end()) {
+            found = std::find_if(cpu_instances.begin(), cpu_instances.end(), same_position);
+        }
+        borderline += is_borderline(*found, mesh, view, frustum, occlusion);
+    }
+    printf("GPU culling of %s : %zu visible, %zu on the CPU, %zu differ, %zu more on a threshold\n", name,
+           gpu_visible.size(), cpu_visible.size(), differences.size() - borderline, borderline);
+    return differences.size() - borderline;
+}
+
+int run_gpu_culling_validation() {
+    constexpr size_t kValidationEntities = 2000;
+    constexpr int kCameraDirections = 4;
+    constexpr int kWidth = 1024;
+    constexpr int kHeight = 768;
+    constexpr GLfloat kWorldHalfSize = 16.0f;
+    constexpr int kOcclusionWidth = 256;
+    constexpr int kOcclusionHeight = 192;
+
+    if (!glfwInit()) {
+        std::cerr << "Failed to initialize GLFW" << std::endl;
+        return 1;
+    }
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow *window = glfwCreateWindow(kWidth, kHeight, "GPU culling validation", nullptr, nullptr);
+    if (nullptr == window) {
+        std::cerr << "Failed to create a GL 4.3 context" << std::endl;
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK || !GpuCuller::is_supported()) {
+        std::cerr << "GPU culling is not supported" << std::endl;
+        glfwTerminate();
+        return 1;
+    }
+
+    GLuint instancedProgramID = LoadShaders("shaders/InstancedVertexShader.glsl",
+                                            "shaders/InstancedFragmentShader.glsl");
+    GLuint cullProgramID = LoadComputeShader("shaders/CullComputeShader.glsl");
+    GeometryArena geometry;
+    geometry.init<QuantizedVertexLayout>(1 << 16, 1 << 18);
+    Mesh target_mesh;
+    Mesh fireball_mesh;
+    int failures = 0;
+    if (cullProgramID == 0 || !target_mesh.load("assets/target.obj", geometry, true) ||
+        !fireball_mesh.load("assets/ball.obj", geometry, true)) {
+        std::cerr << "Failed to load the shaders or the meshes" << std::endl;
+        failures = 1;
+    }
+
+    if (failures == 0) {
+        // Around the cameras, some of them close enough for LOD 0
+        EntityStore targets(kValidationEntities);
+        EntityStore fireballs(kValidationEntities);
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<GLfloat> unit(-1.0f, 1.0f);
+        std::uniform_real_distribution<GLfloat> distance(1.0f, 12.0f);
+        for (size_t i = 0; i < kValidationEntities; ++i) {
+            glm::vec3 direction = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)));
+            Target::spawn(targets, direction * distance(rng));
+            Fireball::spawn(fireballs, -direction * distance(rng), direction);
+        }
+        std::function<InstanceData(size_t)> target_instance = [&](size_t i) {
+            return Target::get_instance(targets, i, 1.0f);
+        };
+        std::function<InstanceData(size_t)> fireball_instance = [&](size_t i) {
+            return Fireball::get_instance(fireballs, i, 1.0f);
+        };
+
+        JobSystem jobs;
+        GLStateTracker gl_state;
+        GpuCuller gpu_culler(cullProgramID, {make_material(instancedProgramID, target_mesh, 0),
+                                             make_material(instancedProgramID, fireball_mesh, 0)});
+        LooseOctree target_octree(kWorldHalfSize);
+        LooseOctree fireball_octree(kWorldHalfSize);
+        std::vector<size_t> visible_targets;
+        std::vector<size_t> visible_fireballs;
+        OcclusionCuller occlusion(kOcclusionWidth, kOcclusionHeight);
+        std::vector<size_t> all_targets(targets.size());
+        for (size_t i = 0; i < all_targets.size(); ++i) {
+            all_targets[i] = i;
+        }
+        target_octree.sync(targets, [&](size_t i) {
+            InstanceData instance = target_instance(i);
+            return BoundingSphere{instance.position, instance.scale * target_mesh.get_bounding_radius()};
+        });
+        fireball_octree.sync(fireballs, [&](size_t i) {
+            InstanceData instance = fireball_instance(i);
+            return BoundingSphere{instance.position, instance.scale * fireball_mesh.get_bounding_radius()};
+        });
+        gpu_culler.set_instances(0, jobs, targets.size(), target_instance);
+        gpu_culler.set_instances(1, jobs, fireballs.size(), fireball_instance);
+
+        const glm::mat4 projection = glm::perspective(glm::radians(45.0f), static_cast<GLfloat>(kWidth) / kHeight,
+                                                      0.1f, 100.0f);
+        for (int c = 0; c < kCameraDirections; ++c) {
+            GLfloat yaw = 2 * glm::pi<GLfloat>() * c / kCameraDirections;
+            glm::vec3 camera_position(0.0f, 0.0f, 0.0f);
+            glm::mat4 view = glm::lookAt(camera_position, glm::vec3(std::sin(yaw), 0.0f, std::cos(yaw)),
+                                         glm::vec3(0.0f, 1.0f, 0.0f));
+            LodView lod_view;
+            lod_view.camera_position = camera_position;
+            lod_view.pixels_per_unit = projection[1][1] * kHeight / 2;
+
+            Frustum frustum = extract_frustum(projection * view);
+            gl_state.begin_frame();
+            occlusion.render_occluders(all_targets, target_instance, target_mesh, view, projection, jobs);
+            gpu_culler.cull(frustum, lod_view, &occlusion, gl_state);
+            target_octree.query(frustum, targets, visible_targets);
+            fireball_octree.query(frustum, fireballs, visible_fireballs);
+            occlusion.cull(visible_targets, target_instance, target_mesh.get_bounding_radius(), jobs);
+            occlusion.cull(visible_fireballs, fireball_instance, fireball_mesh.get_bounding_radius(), jobs);
+            if (validate_gpu_culling("targets", gpu_culler, 0, visible_targets, target_instance, target_mesh,
+                                     lod_view, frustum, &occlusion) != 0 ||
+                validate_gpu_culling("fireballs", gpu_culler, 1, visible_fireballs, fireball_instance,
+                                     fireball_mesh, lod_view, frustum, &occlusion) != 0) {
+                failures = 1;
+            }
+        }
+        gpu_culler.release();
+    }
+
+    fireball_mesh.release();
+    target_mesh.release();
+    geometry.release();
+    glDeleteProgram(instancedProgramID);
+    glDeleteProgram(cullProgramID);
+    glfwTerminate();
+    printf("GPU culling validation %s\n", failures == 0 ? "passed" : "FAILED");
+    return failures;
+}
+
+// A closed torus, kRings x kSides quads, simplified to each target of a LOD
+// chain. Every target takes several passes, and a closed surface has no
+// locked vertex : only the link condition can stop the chain early.
+static int run_simplifier_check() {
+    constexpr int kRings = 16;
+    constexpr int kSides = 16;
+
+    std::vector<glm::vec3> vertices;
+    for (int ring = 0; ring < kRings; ++ring) {
+        for (int side = 0; side < kSides; ++side) {
+            GLfloat a = 2 * glm::pi<GLfloat>() * ring / kRings;
+            GLfloat b = 2 * glm::pi<GLfloat>() * side / kSides;
+            GLfloat r = 2.0f + 0.7f * std::cos(b);
+            vertices.push_back(glm::vec3(r * std::cos(a), r * std::sin(a), 0.7f * std::sin(b)));
+        }
+    }
+    std::vector<unsigned int> indices;
+    for (int ring = 0; ring < kRings; ++ring) {
+        for (int side = 0; side < kSides; ++side) {
+            unsigned int a = ring * kSides + side;
+            unsigned int b = (ring + 1) % kRings * kSides + side;
+            unsigned int c = (ring + 1) % kRings * kSides + (side + 1) % kSides;
+            unsigned int d = ring * kSides + (side + 1) % kSides;
+            indices.insert(indices.end(), {a, b, c, a, c, d});
+        }
+    }
+    // One uv everywhere : no seam
+    std::vector<glm::vec2> uvs(vertices.size(), glm::vec2(0.0f));
+
+    int result = 0;
+    // Far enough from the fewest triangles a torus can keep
+    for (size_t target : {indices.size() / 2, indices.size() / 4, indices.size() / 8, indices.size() / 16}) {
+        std::vector<unsigned int> simplified;
+        float error = simplifyMesh(indices, vertices, uvs, target, simplified);
+        bool reached = simplified.size() <= target;
+        printf("simplifyMesh of a closed torus : %zu -> %zu indices for %zu, error %g%s\n", indices.size(),
+               simplified.size(), target, error, reached ? "" : " - STALLED");
+        if (!reached) {
+            result = 1;
+        }
+    }
+    return result;
+}
+
+// The meshlet statistics of the game's meshes, and whether the cone test is
+// conservative : from kCameras fixed positions around each mesh, every
+// triangle of a meshlet it culls must face away from the camera.
+static int run_meshlet_check() {
+    constexpr int kCameras = 1000;
+
+    int result = 0;
+    for (const char *path : {"assets/target.obj", "assets/ball.obj"}) {
+        MeshBin mesh;
+        if (!loadMeshBin(path, mesh)) {
+            std::cerr << "Can't load " << path << std::endl;
+            result = 1;
+            continue;
+        }
+        printf("%s :\n", path);
+        printMeshletReport(mesh.meshlets, mesh.meshletCount);
+
+        GLfloat radius = 0.0f;
+        for (unsigned int v = 0; v < mesh.vertexCount; ++v) {
+            radius = std::max(radius, glm::length(mesh.positions[v]));
+        }
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<GLfloat> unit(-1.0f, 1.0f);
+        std::uniform_real_distribution<GLfloat> distance(1.1f, 10.0f);
+        const unsigned int *indices = mesh.indices + mesh.lods[0].indexOffset;
+        size_t culled = 0;
+        size_t wrong = 0;
+        for (int c = 0; c < kCameras; ++c) {
+            glm::vec3 camera = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng))) * distance(rng) * radius;
+            for (unsigned int m = 0; m < mesh.meshletCount; ++m) {
+                const Meshlet &meshlet = mesh.meshlets[m];
+                if (!isMeshletBackfacing(meshlet, camera)) {
+                    continue;
+                }
+                for (unsigned int t = 0; t < meshlet.triangleCount; ++t) {
+                    const unsigned int *corners = indices + meshlet.indexOffset + t * 3;
+                    glm::vec3 p0 = mesh.positions[corners[0]];
+                    glm::vec3 normal = glm::cross(mesh.positions[corners[1]] - p0, mesh.positions[corners[2]] - p0);
+                    // Counter-clockwise is the front; a tolerance for edge-on triangles
+                    GLfloat facing = glm::dot(normal, p0 - camera);
+                    wrong += facing < -1e-5f * glm::length(normal) * glm::length(p0 - camera);
+                    ++culled;
+                }
+            }
+        }
+        printf("Cone test from %d cameras : %zu triangles culled, %zu of them facing the camera\n", kCameras,
+               culled, wrong);
+        if (wrong > 0) {
+            result = 1;
+        }
+        closeMeshBin(mesh);
+    }
+    return result;
+}
+
+int run_mesh_checks() {
+    int failures = 0;
+    failures += run_simplifier_check();
+    failures += run_meshlet_check();
+    return failures == 0 ? 0 : 1;
+}
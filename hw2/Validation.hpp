@@ -0,0 +1,37 @@
+#include <functional>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "Mesh.hpp"
+#include "InstanceBatch.hpp"
+#include "GpuCuller.hpp"
+#include "LooseOctree.hpp"
+#include "OcclusionCuller.hpp"
+
+#ifndef HW2_VALIDATION
+#define HW2_VALIDATION
+
+// Reads back what the GPU kept in the last cull of a mesh and compares it,
+// LOD included, with what the CPU kept from the same frustum and occluders
+// (occlusion is nullptr if there were none). The instances the CPU would
+// decide either way with its bounding sphere or its LOD errors a little off
+// are reported apart : float rounding differs between the two there.
+// Returns how many of the others differ.
+size_t validate_gpu_culling(const char *name, const GpuCuller &culler, size_t culler_mesh,
+                            const std::vector<size_t> &visible_indices,
+                            const std::function<InstanceData(size_t)> &get_instance, const Mesh &mesh,
+                            const LodView &view, const Frustum &frustum, const OcclusionCuller *occlusion);
+
+// Culls the same entities from a few fixed cameras with GpuCuller and with
+// the octrees and OcclusionCuller, and compares what both kept. The window
+// stays hidden. Fails on any difference away from a threshold (see
+// validate_gpu_culling), or when the GPU path can't run at all.
+int run_gpu_culling_validation();
+
+// Checks of the mesh processing in common/ that need no GL context : the
+// simplifier, and the meshlets of the game's meshes with their statistics.
+// Prints what each found, and fails if any of them did.
+int run_mesh_checks();
+
+#endif //HW2_VALIDATION
@@ -0,0 +1,54 @@
+#include <cstddef>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <common/vboquantizer.hpp>
+
+#ifndef HW2_VERTEX_LAYOUT
+#define HW2_VERTEX_LAYOUT
+
+// One attribute of an interleaved vertex : its shader location, how GL
+// reads it, and its offset in the vertex
+template<GLuint Location, GLint Size, GLenum Type, GLboolean Normalized, size_t Offset>
+struct VertexAttribute {
+    static void set_pointer(GLsizei stride) {
+        glEnableVertexAttribArray(Location);
+        glVertexAttribPointer(Location, Size, Type, Normalized, stride, reinterpret_cast<void *>(Offset));
+    }
+};
+
+// An interleaved vertex type and the attributes the shaders read from it,
+// fixed at compile time
+template<typename Vertex, typename... Attributes>
+struct VertexLayout {
+    typedef Vertex VertexType;
+
+    // Points the attributes of the bound vertex array at the buffer bound
+    // to GL_ARRAY_BUFFER
+    static void set_pointers() {
+        int expand[] = {0, (Attributes::set_pointer(sizeof(Vertex)), 0)...};
+        (void) expand;
+    }
+};
+
+// Vertices of a mesh loaded without quantization
+struct FloatVertex {
+    glm::vec3 position;
+    glm::vec2 uv;
+};
+
+typedef VertexLayout<FloatVertex,
+        VertexAttribute<0, 3, GL_FLOAT, GL_FALSE, offsetof(FloatVertex, position)>,
+        VertexAttribute<1, 2, GL_FLOAT, GL_FALSE, offsetof(FloatVertex, uv)>> FloatVertexLayout;
+
+// Positions mapped to [0, 1] by the fixed function. Normals kept as
+// integers and divided by 127 in the shader : GL 3.3 doesn't say whether a
+// normalized byte maps -128 or -127 to -1.
+typedef VertexLayout<QuantizedVertex,
+        VertexAttribute<0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(QuantizedVertex, position)>,
+        VertexAttribute<1, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(QuantizedVertex, uv)>,
+        VertexAttribute<2, 2, GL_BYTE, GL_FALSE, offsetof(QuantizedVertex, normal)>> QuantizedVertexLayout;
+
+#endif //HW2_VERTEX_LAYOUT
@@ -5,6 +5,9 @@
 #include <random>
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <functional>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -16,10 +19,24 @@ GLFWwindow *window;
 #include <common/shader.hpp>
 #include <common/texture.hpp>
 #include <common/controls.hpp>
+#include <common/jobsystem.hpp>
 #include <common/objloader.hpp>
 
+#include "Mesh.hpp"
 #include "Target.hpp"
 #include "Fireball.hpp"
+#include "EntityStore.hpp"
+#include "InstanceBatch.hpp"
+#include "CollisionGrid.hpp"
+#include "LooseOctree.hpp"
+#include "RenderQueue.hpp"
+#include "GLStateTracker.hpp"
+#include "GeometryArena.hpp"
+#include "VertexLayout.hpp"
+#include "GpuCuller.hpp"
+#include "OcclusionCuller.hpp"
+#include "Benchmarks.hpp"
+#include "Validation.hpp"
 
 class Game {
 public:
@@ -32,17 +49,28 @@ public:
         }
 
         glfwWindowHint(GLFW_SAMPLES, 4);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
         glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-        window = glfwCreateWindow(1024, 768, "Shoot the target", nullptr, nullptr);
+        // 4.3 for the compute shader of GpuCuller. Where there is only 3.3,
+        // the octree and the CPU occlusion culling are the fallback.
+        const int versions[][2] = {{4, 3}, {3, 3}};
+        window = nullptr;
+        for (const auto &version : versions) {
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+            window = glfwCreateWindow(kWindowWidth, kWindowHeight, "Shoot the target", nullptr, nullptr);
+            if (nullptr != window) {
+                break;
+            }
+        }
         if (nullptr == window) {
             std::cerr << "Failed to open GLFW window" << std::endl;
             glfwTerminate();
             loaded = false;
         }
         glfwMakeContextCurrent(window);
+        // The simulation doesn't depend on the frame rate anymore
+        glfwSwapInterval(kVSync ? 1 : 0);
 
         glewExperimental = GL_TRUE;
         if (glewInit() != GLEW_OK) {
@@ -59,66 +87,56 @@ public:
         // Grey layout
         glClearColor(0.5f, 0.5f, 0.5f, 0.0f);
 
-        glGenVertexArrays(1, &VertexArrayID);
-        glBindVertexArray(VertexArrayID);
-
-        // Create and compile our GLSL program from the shaders
-        targetProgramID = LoadShaders("shaders/VertexShader.glsl",
+        // Create and compile our GLSL program from the shaders. Targets and
+        // fireballs share one, so that switching between them is no program change.
+        objectProgramID = LoadShaders("shaders/VertexShader.glsl",
                                       "shaders/FragmentShader.glsl");
-        fireballProgramID = LoadShaders("shaders/VertexShader.glsl",
-                                        "shaders/FragmentShader.glsl");
+        instancedProgramID = LoadShaders("shaders/InstancedVertexShader.glsl",
+                                         "shaders/InstancedFragmentShader.glsl");
+
+        // Set our samplers to use Texture Unit 0, and 1 for the second mesh of
+        // a GPU culled draw, once : it is state of the programs
+        glUseProgram(objectProgramID);
+        glUniform1i(glGetUniformLocation(objectProgramID, "myTextureSampler"), 0);
+        const GLint mesh_texture_units[GpuCuller::kMaxMeshes] = {0, 1};
+        glUseProgram(instancedProgramID);
+        glUniform1iv(glGetUniformLocation(instancedProgramID, "mesh_textures"), GpuCuller::kMaxMeshes,
+                     mesh_texture_units);
+
+        // The GPU culling path needs compute shaders. Without them, or if the
+        // shader doesn't build, the octrees do the culling.
+        gpuCulling = kGpuCulling && kInstancedRendering && GpuCuller::is_supported();
+        cullProgramID = gpuCulling ? LoadComputeShader("shaders/CullComputeShader.glsl") : 0;
+        gpuCulling &= cullProgramID != 0;
 
         // load textures
         lavaTexture = loadBMP_custom("assets/lava.bmp");
         goldTexture = loadBMP_custom("assets/gold.bmp");
 
-        std::vector<glm::vec3> normals; // we won't use it, so it's local
-        // Read our .obj file
-        bool op1_res = loadOBJ("assets/target.obj", target_vertices, target_uv, normals);
-        if (op1_res) {
-            // Load it into a VBO
-            glGenBuffers(1, &target_vertexbuffer);
-            glBindBuffer(GL_ARRAY_BUFFER, target_vertexbuffer);
-            glBufferData(GL_ARRAY_BUFFER, target_vertices.size() * sizeof(glm::vec3), &target_vertices[0],
-                         GL_STATIC_DRAW);
-
-            glGenBuffers(1, &target_uvbuffer);
-            glBindBuffer(GL_ARRAY_BUFFER, target_uvbuffer);
-            glBufferData(GL_ARRAY_BUFFER, target_uv.size() * sizeof(glm::vec2), &target_uv[0],
-                         GL_STATIC_DRAW);
-        }
-        else {
-            std::cerr << "Failed to load .obj" << std::endl;
-            loaded = false;
+        // Read our .obj files through their binary caches and load them
+        // into buffers shared by every mesh
+        if (kQuantizeVertices) {
+            geometry.init<QuantizedVertexLayout>(kArenaVertices, kArenaIndices);
+        } else {
+            geometry.init<FloatVertexLayout>(kArenaVertices, kArenaIndices);
         }
-        // Read our .obj file
-        bool op2_res = loadOBJ("assets/ball.obj", fireball_vertices, fireball_uv, normals);
-        if (op2_res) {
-            // Load it into a VBO
-            glGenBuffers(1, &fireball_vertexbuffer);
-            glBindBuffer(GL_ARRAY_BUFFER, fireball_vertexbuffer);
-            glBufferData(GL_ARRAY_BUFFER, fireball_vertices.size() * sizeof(glm::vec3), &fireball_vertices[0], GL_STATIC_DRAW);
-
-            glGenBuffers(1, &fireball_uvbuffer);
-            glBindBuffer(GL_ARRAY_BUFFER, fireball_uvbuffer);
-            glBufferData(GL_ARRAY_BUFFER, fireball_uv.size() * sizeof(glm::vec2), &fireball_uv[0], GL_STATIC_DRAW);
-        }
-        else {
+        if (!target_mesh.load("assets/target.obj", geometry, kQuantizeVertices) ||
+            !fireball_mesh.load("assets/ball.obj", geometry, kQuantizeVertices)) {
             std::cerr << "Failed to load .obj" << std::endl;
             loaded = false;
         }
+        print_arena_stats(geometry.get_stats());
     }
 
     ~Game() {
         // Cleanup VBO
-        glDeleteVertexArrays(1, &VertexArrayID);
-        glDeleteProgram(targetProgramID);
-        glDeleteProgram(fireballProgramID);
+        glDeleteProgram(objectProgramID);
+        glDeleteProgram(instancedProgramID);
+        glDeleteProgram(cullProgramID);
 
-        glDeleteBuffers(1, &fireball_vertexbuffer);
-        glDeleteBuffers(1, &fireball_uvbuffer);
-        glDeleteBuffers(1, &target_vertexbuffer);
-        glDeleteBuffers(1, &target_uvbuffer);
+        fireball_mesh.release();
+        target_mesh.release();
+        geometry.release();
 
         glfwTerminate();
     }
@@ -128,8 +146,36 @@ public:
             return -1;
         }
 
-        std::vector<Target> targets;
-        std::vector<Fireball> fireballs;
+        // The spawns below only recycle slots of these
+        EntityStore targets(kMaxTargets);
+        EntityStore fireballs(kMaxFireballs);
+        const Target target_kind(objectProgramID, target_mesh, goldTexture);
+        const Fireball fireball_kind(objectProgramID, fireball_mesh, lavaTexture);
+        CollisionGrid collision_grid;
+        // Per-entity work goes to the threads, GL calls stay on this one
+        JobSystem jobs;
+
+        // Only what the camera sees is drawn
+        LooseOctree target_octree(kWorldHalfSize);
+        LooseOctree fireball_octree(kWorldHalfSize);
+        std::vector<size_t> visible_targets;
+        std::vector<size_t> visible_fireballs;
+        // Occluder candidates of the GPU path
+        std::vector<size_t> all_targets;
+        double last_stats_time = glfwGetTime();
+
+        // One upload and one draw per LOD for each kind of object
+        InstanceBatch target_batch(instancedProgramID, target_mesh, goldTexture);
+        InstanceBatch fireball_batch(instancedProgramID, fireball_mesh, lavaTexture);
+        // Only used with gpuCulling : both kinds in one draw
+        GpuCuller gpu_culler(cullProgramID, {target_batch.get_material(), fireball_batch.get_material()});
+        // What the octrees or the GPU kept, minus what hides behind the
+        // nearest targets
+        OcclusionCuller occlusion(kOcclusionWidth, kOcclusionHeight);
+
+        // Draws are sorted by state, and binds already in effect are skipped
+        RenderQueue render_queue;
+        GLStateTracker gl_state;
 
         int total_shoots = 0;
         int total_hits = 0;
@@ -144,12 +190,16 @@ public:
 
         // Set the mouse at the center of the screen
         glfwPollEvents();
-        glfwSetCursorPos(window, 1024.0 / 2, 768.0 / 2);
+        glfwSetCursorPos(window, kWindowWidth / 2.0, kWindowHeight / 2.0);
 
         int mouseState = GLFW_RELEASE;
 
         double last_add_time = glfwGetTime();
 
+        // Simulation time not simulated yet
+        double last_frame_time = glfwGetTime();
+        double sim_accumulator = 0.0;
+
         do {
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -160,50 +210,118 @@ public:
             glm::mat4 ModelMatrix = glm::mat4(1.0);
             glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
 
+            // ProjectionMatrix[1][1] is 1 / tan(fov / 2) : NDC units per unit at distance 1
+            LodView lod_view;
+            lod_view.camera_position = getPosition();
+            lod_view.pixels_per_unit = ProjectionMatrix[1][1] * kWindowHeight / 2;
+
             double curr_time = glfwGetTime();
 
-            if (curr_time - last_add_time > 1 && targets.size() < 16) {
+            if (curr_time - last_add_time > 1 && targets.size() < kMaxTargets) {
                 spawn_target(targets);
                 last_add_time = curr_time;
             }
 
             int currMouseState = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT);
-            if (mouseState == GLFW_RELEASE && currMouseState == GLFW_PRESS) {
+            if (mouseState == GLFW_RELEASE && currMouseState == GLFW_PRESS && !fireballs.full()) {
                 total_shoots += 1;
                 spawn_fireball(fireballs);
             }
             mouseState = currMouseState;
 
-            // Colliding proccessing
-            for (size_t i = 0; i < fireballs.size(); ++i) {
-                bool collided = false;
-                glm::vec3 pos = fireballs[i].get_current_position();
-                for (size_t j = 0; j < targets.size(); ++j) {
-                    if (targets[j].is_close_to_point(pos)) {
-                        total_hits += 1;
-                        collided = true;
-                        targets.erase(targets.begin() + j);
-                        --j;
+            // Fixed simulation steps for the time that went by. Don't try to
+            // catch up on more than kMaxFrameTime after a stall.
+            sim_accumulator += std::min(curr_time - last_frame_time, kMaxFrameTime);
+            last_frame_time = curr_time;
+            while (sim_accumulator >= kSimStep) {
+                targets.save_previous();
+                fireballs.save_previous();
+
+                // Colliding proccessing
+                total_hits += collision_grid.resolve(fireballs, targets);
+
+                // Moving, and dropping the fireballs that got too far
+                Target::update(targets, static_cast<GLfloat>(kSimStep), jobs);
+                Fireball::update(fireballs, static_cast<GLfloat>(kSimStep), jobs);
+
+                sim_accumulator -= kSimStep;
+            }
+
+            // Drawing, between the last two steps
+            GLfloat alpha = static_cast<GLfloat>(sim_accumulator / kSimStep);
+
+            std::function<InstanceData(size_t)> target_instance = [&](size_t i) {
+                return Target::get_instance(targets, i, alpha);
+            };
+            std::function<InstanceData(size_t)> fireball_instance = [&](size_t i) {
+                return Fireball::get_instance(fireballs, i, alpha);
+            };
+            gl_state.begin_frame();
+
+            // Frustum culling
+            Frustum frustum = extract_frustum(ProjectionMatrix * ViewMatrix);
+            if (!gpuCulling || kValidateGpuCulling) {
+                target_octree.sync(targets, [&](size_t i) {
+                    InstanceData instance = target_instance(i);
+                    return BoundingSphere{instance.position, instance.scale * target_mesh.get_bounding_radius()};
+                });
+                fireball_octree.sync(fireballs, [&](size_t i) {
+                    InstanceData instance = fireball_instance(i);
+                    return BoundingSphere{instance.position, instance.scale * fireball_mesh.get_bounding_radius()};
+                });
+                target_octree.query(frustum, targets, visible_targets);
+                fireball_octree.query(frustum, fireballs, visible_fireballs);
+            }
+            // The occluders come from the targets the octree kept. The GPU
+            // path has no such list : the nearest of all the targets then.
+            if (kOcclusionCulling) {
+                if (gpuCulling) {
+                    all_targets.resize(targets.size());
+                    for (size_t i = 0; i < all_targets.size(); ++i) {
+                        all_targets[i] = i;
                     }
                 }
-                if (collided) {
-                    fireballs.erase(fireballs.begin() + i);
-                    --i;
+                occlusion.render_occluders(gpuCulling ? all_targets : visible_targets, target_instance, target_mesh,
+                                           ViewMatrix, ProjectionMatrix, jobs);
+                if (!gpuCulling || kValidateGpuCulling) {
+                    occlusion.cull(visible_targets, target_instance, target_mesh.get_bounding_radius(), jobs);
+                    occlusion.cull(visible_fireballs, fireball_instance, fireball_mesh.get_bounding_radius(), jobs);
                 }
             }
+            if (gpuCulling) {
+                gpu_culler.set_instances(kTargetMesh, jobs, targets.size(), target_instance);
+                gpu_culler.set_instances(kFireballMesh, jobs, fireballs.size(), fireball_instance);
+                gpu_culler.cull(frustum, lod_view, kOcclusionCulling ? &occlusion : nullptr, gl_state);
+            }
+
+            if (gpuCulling) {
+                // Drawn after the queue
+            } else if (kInstancedRendering) {
+                Target::add_to(targets, visible_targets, target_batch, lod_view, alpha, jobs);
+                Fireball::add_to(fireballs, visible_fireballs, fireball_batch, lod_view, alpha, jobs);
+                render_queue.push(target_batch);
+                render_queue.push(fireball_batch);
+            } else {
+                target_kind.record(targets, visible_targets, render_queue, lod_view, alpha);
+                fireball_kind.record(fireballs, visible_fireballs, render_queue, lod_view, alpha);
+            }
 
-            // Drawing targets
-            for (int i = 0; i < targets.size(); ++i) {
-                targets[i].draw(MVP);
+            render_queue.submit(MVP, gl_state);
+            if (gpuCulling) {
+                gpu_culler.draw(MVP, gl_state);
             }
 
-            // Drawing fireballs
-            for (int i = 0; i < fireballs.size(); ++i) {
-                // Too far fireball case
-                if (!fireballs[i].draw(MVP)) {
-                    fireballs.erase(fireballs.begin() + i);
-                    --i;
+            if (curr_time - last_stats_time > 1) {
+                show_frame_stats(target_octree.get_stats(), fireball_octree.get_stats(), gl_state.get_stats(),
+                                 occlusion.get_stats(), gpuCulling && !kValidateGpuCulling);
+                if (gpuCulling && kValidateGpuCulling) {
+                    const OcclusionCuller *occluders = kOcclusionCulling ? &occlusion : nullptr;
+                    validate_gpu_culling("targets", gpu_culler, kTargetMesh, visible_targets, target_instance,
+                                         target_mesh, lod_view, frustum, occluders);
+                    validate_gpu_culling("fireballs", gpu_culler, kFireballMesh, visible_fireballs,
+                                         fireball_instance, fireball_mesh, lod_view, frustum, occluders);
                 }
+                last_stats_time = curr_time;
             }
 
             // Swap buffers
@@ -212,37 +330,74 @@ public:
 
         } while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS && glfwWindowShouldClose(window) == 0);
 
+        target_batch.release();
+        fireball_batch.release();
+        gpu_culler.release();
         return 0;
     }
 private:
-    // Vertex array ID
-    GLuint VertexArrayID;
-
     // Shaders ID
-    GLuint targetProgramID;
-    GLuint fireballProgramID;
+    GLuint objectProgramID;
+    GLuint instancedProgramID;
+    GLuint cullProgramID;
 
     // Texture IDs
     GLuint lavaTexture;
     GLuint goldTexture;
 
 
-    std::vector<glm::vec3> fireball_vertices;
-    std::vector<glm::vec2> fireball_uv;
-    GLuint fireball_vertexbuffer;
-    GLuint fireball_uvbuffer;
-
-    std::vector<glm::vec3> target_vertices;
-    std::vector<glm::vec2> target_uv;
-    GLuint target_vertexbuffer;
-    GLuint target_uvbuffer;
+    // Meshes, and the buffers they live in
+    GeometryArena geometry;
+    Mesh fireball_mesh;
+    Mesh target_mesh;
 
     bool loaded;
-
-    void spawn_target(std::vector<Target> &targets) const {
-        auto new_target = Target(targetProgramID, target_vertexbuffer, target_uvbuffer, target_vertices.size() * 3);
-        new_target.set_texture(goldTexture);
-
+    bool gpuCulling;
+
+    // Compressed vertex format : 12 bytes per vertex instead of 20
+    constexpr static bool kQuantizeVertices = true;
+
+    // Starting sizes of the geometry buffers, which grow as needed
+    constexpr static size_t kArenaVertices = 1 << 16;
+    constexpr static size_t kArenaIndices = 1 << 18;
+
+    // All the targets in one draw call, and all the fireballs in another,
+    // instead of a full state setup per object
+    constexpr static bool kInstancedRendering = true;
+
+    // Frustum culling and LOD selection in a compute shader, when the
+    // driver has GL 4.3. With kValidateGpuCulling, the octrees still run and
+    // their result is compared with what the GPU kept, once a second.
+    constexpr static bool kGpuCulling = true;
+    constexpr static bool kValidateGpuCulling = false;
+    // Order of the materials given to the GpuCuller
+    constexpr static size_t kTargetMesh = 0;
+    constexpr static size_t kFireballMesh = 1;
+
+    // Objects hidden behind the nearest targets are dropped too, tested
+    // against a depth buffer of this size. The GPU path tests against the
+    // same buffer, uploaded every frame.
+    constexpr static bool kOcclusionCulling = true;
+    constexpr static int kOcclusionWidth = 256;
+    constexpr static int kOcclusionHeight = 192;
+
+    // Simulation rate, whatever the frame rate
+    constexpr static double kSimStep = 1.0 / 120.0;
+    constexpr static double kMaxFrameTime = 0.25;
+    constexpr static bool kVSync = true;
+
+    // Half size of the cube the octrees divide. Fireballs die 10 units away
+    // from the origin; anything further stays in the root.
+    constexpr static GLfloat kWorldHalfSize = 16.0f;
+
+    constexpr static size_t kMaxTargets = 16;
+    // Past this many fireballs in flight, clicks don't shoot
+    constexpr static size_t kMaxFireballs = 256;
+
+    constexpr static int kWindowWidth = 1024;
+    constexpr static int kWindowHeight = 768;
+
+    void spawn_target(EntityStore &targets) const {
         const double r = 2.0 + static_cast<double>(rand()) / (static_cast<double>(RAND_MAX / (10.0 - 2.0)));
         const double phi = static_cast<double>(rand()) / (static_cast<double>(RAND_MAX / (2 * glm::pi<float>() - 0.0)));
         const double psi = static_cast<double>(rand()) / (static_cast<double>(RAND_MAX / (2 * glm::pi<float>() - 0.0)));
@@ -252,24 +407,58 @@ private:
                 cos(phi) * cos(psi) * r
         );
 
-        new_target.set_coordinates(pos);
-
-        targets.push_back(new_target);
+        Target::spawn(targets, pos);
     }
 
-    void spawn_fireball(std::vector<Fireball> &fireballs) const {
-        auto new_fireball = Fireball(fireballProgramID, fireball_vertexbuffer, fireball_uvbuffer, fireball_vertices.size() * 3);
-        new_fireball.set_texture_id(lavaTexture);
-        new_fireball.set_coordinates(getPosition());
-        new_fireball.set_move_direction(getDirection());
+    // In the title bar, to keep the console quiet. The cull counts are only
+    // known when the octrees ran : the GPU path would need a readback.
+    static void show_frame_stats(const CullStats &targets, const CullStats &fireballs, const StateChangeStats &state,
+                                 const OcclusionStats &occlusion, bool culled_on_gpu) {
+        char title[384];
+        if (culled_on_gpu) {
+            snprintf(title, sizeof(title),
+                     "Shoot the target - culled on the GPU, counts not read back - %zu occluder triangles"
+                     " rasterized in %.2f ms - %zu state changes, %zu avoided",
+                     occlusion.occluder_triangles, occlusion.milliseconds, state.issued, state.avoided);
+        } else {
+            double occluded_percent = occlusion.tested_objects == 0
+                                      ? 0.0 : 100.0 * occlusion.culled_objects / occlusion.tested_objects;
+            snprintf(title, sizeof(title),
+                     "Shoot the target - targets %zu drawn, %zu culled - fireballs %zu drawn, %zu culled"
+                     " - %zu nodes visited - %zu occluded (%.1f%%) by %zu occluder triangles in %.2f ms"
+                     " - %zu state changes, %zu avoided",
+                     targets.visible_objects, targets.culled_objects, fireballs.visible_objects,
+                     fireballs.culled_objects, targets.visited_nodes + fireballs.visited_nodes,
+                     occlusion.culled_objects, occluded_percent, occlusion.occluder_triangles,
+                     occlusion.milliseconds, state.issued, state.avoided);
+        }
+        glfwSetWindowTitle(window, title);
+    }
 
-        fireballs.push_back(new_fireball);
+    static void print_arena_stats(const GeometryArenaStats &stats) {
+        printf("Geometry : %zu / %zu vertices, %zu / %zu indices, %zu + %zu free blocks, "
+               "fragmentation %.1f%% / %.1f%%\n",
+               stats.vertices.used, stats.vertices.capacity, stats.indices.used, stats.indices.capacity,
+               stats.vertices.free_blocks, stats.indices.free_blocks, 100.0f * stats.vertices.fragmentation,
+               100.0f * stats.indices.fragmentation);
     }
 
+    void spawn_fireball(EntityStore &fireballs) const {
+        Fireball::spawn(fireballs, getPosition(), getDirection());
+    }
 
 };
 
-int main() {
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--benchmark") == 0) {
+        return run_benchmarks();
+    }
+    if (argc > 1 && strcmp(argv[1], "--validate-gpu-culling") == 0) {
+        return run_gpu_culling_validation();
+    }
+    if (argc > 1 && strcmp(argv[1], "--check-meshes") == 0) {
+        return run_mesh_checks();
+    }
     auto game = Game();
     int op_code = game.run();
     return op_code;
@@ -0,0 +1,155 @@
+#version 430 core
+
+// Frustum culling, occlusion culling and LOD selection of the instances of
+// one mesh, for GpuCuller, which dispatches it once per mesh. Same tests as
+// LooseOctree::query, OcclusionCuller::cull and Mesh::select_lod.
+layout(local_size_x = 64) in;
+
+// InstanceData : position in xyz, spin angle around Z, scale. The instances
+// of every mesh, one after the other.
+layout(std430, binding = 0) readonly buffer Instances {
+    float instances[];
+};
+
+// One region of lod_capacity instances per draw command, read back as
+// per-instance attributes by the indirect draw. Each instance is followed
+// by the index of its mesh.
+layout(std430, binding = 1) writeonly buffer VisibleInstances {
+    float visible_instances[];
+};
+
+// DrawElementsIndirectCommand, one per LOD of every mesh
+struct DrawCommand {
+    uint count;
+    uint instance_count;
+    uint first_index;
+    int base_vertex;
+    uint base_instance;
+};
+layout(std430, binding = 2) buffer DrawCommands {
+    DrawCommand commands[];
+};
+
+// OcclusionCuller's depth pyramid (see DepthBuffer in
+// common/depthraster.hpp), every level row by row, one after the other.
+// Depths are 1/w : larger is nearer.
+layout(std430, binding = 3) readonly buffer DepthPyramid {
+    float pyramid[];
+};
+
+// Of this dispatch's mesh
+uniform uint instance_count;
+uniform uint first_instance;
+uniform uint first_command;
+uniform float mesh_index;
+// At scale 1
+uniform float bounding_radius;
+
+uniform vec4 frustum_planes[6];
+uniform vec3 camera_position;
+uniform float pixels_per_unit;
+uniform float lod_pixel_error;
+uniform uint lod_count;
+// In model units. At most kMeshBinMaxLods.
+uniform float lod_errors[6];
+uniform uint lod_capacity;
+
+// No occlusion test when 0. At most GpuCuller::kMaxPyramidLevels.
+uniform uint pyramid_levels;
+uniform uint pyramid_offsets[12];
+uniform ivec2 pyramid_sizes[12];
+// Of the frame the occluders were drawn from
+uniform mat4 occlusion_view;
+// projection[0][0] and projection[1][1]
+uniform vec2 occlusion_scale;
+uniform float occlusion_near_plane;
+
+const uint kInstanceFloats = 5u;
+const uint kVisibleFloats = 6u;
+
+// Same code as isRectVisible in common/depthraster.cpp
+bool is_rect_visible(vec2 rect_min, vec2 rect_max, float nearest_inv_w) {
+    vec2 size = vec2(pyramid_sizes[0]);
+    if (any(lessThan(rect_max, vec2(0.0))) || any(greaterThanEqual(rect_min, size))) {
+        return true;
+    }
+    // Widened by a pixel, for the occluders' pixel center sampling
+    ivec2 p0 = ivec2(max(rect_min - 1.0, vec2(0.0)));
+    ivec2 p1 = ivec2(min(rect_max + 1.0, size - 1.0));
+
+    // The finest level where the rectangle spans at most 3x3 texels
+    int level = 0;
+    while (uint(level + 1) < pyramid_levels &&
+           ((p1.x >> level) - (p0.x >> level) > 2 || (p1.y >> level) - (p0.y >> level) > 2)) {
+        ++level;
+    }
+
+    uint offset = pyramid_offsets[level];
+    int width = pyramid_sizes[level].x;
+    for (int y = p0.y >> level; y <= (p1.y >> level); ++y) {
+        for (int x = p0.x >> level; x <= (p1.x >> level); ++x) {
+            if (nearest_inv_w >= pyramid[offset + uint(y * width + x)]) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Same code as OcclusionCuller::is_sphere_visible
+bool is_sphere_visible(vec3 position, float radius) {
+    vec4 center = occlusion_view * vec4(position, 1.0);
+    float w = -center.z;
+    // Touching the near plane : can't be behind anything
+    if (w - radius < occlusion_near_plane) {
+        return true;
+    }
+
+    // x / w and y / w over the box around the sphere peak at its corners
+    vec2 rect_min = vec2(1e30);
+    vec2 rect_max = vec2(-1e30);
+    for (int corner = 0; corner < 4; ++corner) {
+        float corner_w = (corner & 2) == 0 ? w - radius : w + radius;
+        float side = (corner & 1) == 0 ? -1.0 : 1.0;
+        vec2 ndc = occlusion_scale * (center.xy + side * radius) / corner_w;
+        rect_min = min(rect_min, ndc);
+        rect_max = max(rect_max, ndc);
+    }
+    vec2 size = vec2(pyramid_sizes[0]);
+    return is_rect_visible((rect_min * 0.5 + 0.5) * size, (rect_max * 0.5 + 0.5) * size, 1.0 / (w - radius));
+}
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= instance_count) {
+        return;
+    }
+    uint first = (first_instance + i) * kInstanceFloats;
+    vec3 position = vec3(instances[first], instances[first + 1u], instances[first + 2u]);
+    float scale = instances[first + 4u];
+
+    float radius = scale * bounding_radius;
+    for (int plane = 0; plane < 6; ++plane) {
+        if (dot(frustum_planes[plane].xyz, position) + frustum_planes[plane].w < -radius) {
+            return;
+        }
+    }
+    if (pyramid_levels > 0u && !is_sphere_visible(position, radius)) {
+        return;
+    }
+
+    // The errors only grow along the chain
+    float camera_distance = distance(position, camera_position);
+    uint lod = 0u;
+    while (lod + 1u < lod_count && lod_errors[lod + 1u] * scale * pixels_per_unit < lod_pixel_error * camera_distance) {
+        ++lod;
+    }
+
+    uint command = first_command + lod;
+    uint slot = atomicAdd(commands[command].instance_count, 1u);
+    uint destination = (command * lod_capacity + slot) * kVisibleFloats;
+    for (uint k = 0u; k < kInstanceFloats; ++k) {
+        visible_instances[destination + k] = instances[first + k];
+    }
+    visible_instances[destination + kInstanceFloats] = mesh_index;
+}
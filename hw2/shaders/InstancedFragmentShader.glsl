@@ -0,0 +1,19 @@
+#version 330 core
+
+// Same as FragmentShader.glsl, but with one texture unit per mesh of a
+// GpuCuller draw (see GpuCuller::kMaxMeshes). InstanceBatch binds its mesh's
+// texture to unit 0, and its instances have mesh index 0.
+in vec2 UV;
+flat in int MeshIndex;
+
+out vec3 color;
+
+uniform sampler2D mesh_textures[2];
+
+void main()
+{
+    // GLSL 3.30 only indexes sampler arrays with constants
+    vec3 first = texture(mesh_textures[0], UV).rgb;
+    vec3 second = texture(mesh_textures[1], UV).rgb;
+    color = MeshIndex == 0 ? first : second;
+}
@@ -0,0 +1,51 @@
+#version 330 core
+
+// Same as VertexShader.glsl, but the model matrix is built from per-instance
+// attributes (see InstanceData in InstanceBatch.hpp) instead of a uniform.
+layout(location = 0) in vec3 vertexPosition_modelspace;
+layout(location = 1) in vec2 vertexUV;
+layout(location = 2) in vec2 vertexNormal_octahedral;
+
+// Per instance : position in xyz, spin angle around Z in w
+layout(location = 3) in vec4 instancePosition_spin;
+layout(location = 4) in float instanceScale;
+// Which mesh of a GpuCuller draw the instance belongs to. InstanceBatch
+// leaves the attribute disabled, which reads as 0.
+layout(location = 5) in float instanceMesh;
+
+out vec2 UV;
+out vec3 Normal_modelspace;
+flat out int MeshIndex;
+
+// Values that stay constant for the whole batch. One dequantization per
+// mesh of a GpuCuller draw, see GpuCuller::kMaxMeshes.
+uniform mat4 MVP;
+uniform vec3 position_offset[2];
+uniform vec3 position_scale[2];
+
+// Same code as octDecode in common/vboquantizer.cpp
+vec3 oct_decode(vec2 encoded) {
+    vec2 e = max(encoded / 127.0, vec2(-1.0));
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        vec2 s = mix(vec2(-1.0), vec2(1.0), greaterThanEqual(n.xy, vec2(0.0)));
+        n.xy = (1.0 - abs(n.yx)) * s;
+    }
+    return normalize(n);
+}
+
+void main() {
+    MeshIndex = int(instanceMesh);
+    vec3 position = (position_offset[MeshIndex] + vertexPosition_modelspace * position_scale[MeshIndex]) * instanceScale;
+
+    // translate * rotate around Z * scale, like Target and Fireball build it
+    float c = cos(instancePosition_spin.w);
+    float s = sin(instancePosition_spin.w);
+    vec3 world = vec3(c * position.x - s * position.y,
+                      s * position.x + c * position.y,
+                      position.z) + instancePosition_spin.xyz;
+
+    gl_Position = MVP * vec4(world, 1);
+    UV = vertexUV;
+    Normal_modelspace = oct_decode(vertexNormal_octahedral);
+}
@@ -1,16 +1,36 @@
 #version 330 core
 
 // Input vertex data, different for all executions of this shader.
+// A quantized mesh gives 16-bit normalized positions (in [0, 1] here), half
+// float uvs and octahedral normals as 2 bytes.
 layout(location = 0) in vec3 vertexPosition_modelspace;
 layout(location = 1) in vec2 vertexUV;
+layout(location = 2) in vec2 vertexNormal_octahedral;
 
 out vec2 UV;
+out vec3 Normal_modelspace;
 
 // Values that stay constant for the whole mesh.
 uniform mat4 MVP;
-uniform mat4 rotation_matrix;
+// Model matrix without its (0, 0, 0, 1) row, see AffineMatrix in common/trsbatch.hpp
+uniform mat4x3 rotation_matrix;
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+
+// Same code as octDecode in common/vboquantizer.cpp
+vec3 oct_decode(vec2 encoded) {
+    vec2 e = max(encoded / 127.0, vec2(-1.0));
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        vec2 s = mix(vec2(-1.0), vec2(1.0), greaterThanEqual(n.xy, vec2(0.0)));
+        n.xy = (1.0 - abs(n.yx)) * s;
+    }
+    return normalize(n);
+}
 
 void main() {
-    gl_Position =  MVP * rotation_matrix * vec4(vertexPosition_modelspace, 1);
+    vec3 position = position_offset + vertexPosition_modelspace * position_scale;
+    gl_Position =  MVP * vec4(rotation_matrix * vec4(position, 1), 1);
     UV = vertexUV;
+    Normal_modelspace = oct_decode(vertexNormal_octahedral);
 }